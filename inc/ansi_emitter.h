@@ -0,0 +1,408 @@
+#ifndef TVP_ANSI_EMITTER_H
+#define TVP_ANSI_EMITTER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+#include "pixelmap.h"
+
+// most bytes one cell can take: an absolute cursor move, the longest move that is ever picked,
+// with coordinates of up to 5 digits (14), both 24 bit colours (36) and a glyph (3), plus the
+// byte the fixed size glyph copy writes past the end. copies of numbers are always followed by
+// more of the same sequence, which overwrites what they write past their end
+#define ANSI_MAX_MOVE_BYTES (3 + 5 + 1 + 5)
+#define ANSI_MAX_COLORS_BYTES (7 + 11 + 6 + 11 + 1)
+#define ANSI_MAX_CELL_BYTES (ANSI_MAX_MOVE_BYTES + ANSI_MAX_COLORS_BYTES + 3 + 1)
+// a colour channel value which stands for a colour the terminal is not known to have
+#define ANSI_SGR_UNKNOWN 1000
+// a space, which only shows the background colour, follows the glyphs of the pixelmap
+#define ANSI_BLANK DIFF_CASES
+#define ANSI_GLYPHS (DIFF_CASES + 1)
+// longest gap of cells that blanks are written over instead of moving past them, a blank is
+// one byte and a move right takes 3 bytes for one cell and 4 for up to 9
+#define ANSI_MAX_OVERPRINT 3
+
+// the decimal text of 0 to 999, written as a fixed 3 byte copy of which len bytes are kept
+struct ansi_number {
+    char text[3];
+    unsigned char len;
+};
+
+constexpr std::array<ansi_number, 1000> make_ansi_numbers() {
+    std::array<ansi_number, 1000> numbers{};
+    for (int v = 0; v < 1000; v++) {
+        ansi_number &n = numbers[v];
+        if (v >= 100) {
+            n.text[0] = static_cast<char>('0' + v / 100);
+            n.text[1] = static_cast<char>('0' + v / 10 % 10);
+            n.text[2] = static_cast<char>('0' + v % 10);
+            n.len = 3;
+        } else if (v >= 10) {
+            n.text[0] = static_cast<char>('0' + v / 10);
+            n.text[1] = static_cast<char>('0' + v % 10);
+            n.len = 2;
+        } else {
+            n.text[0] = static_cast<char>('0' + v);
+            n.len = 1;
+        }
+    }
+    return numbers;
+}
+
+constexpr std::array<ansi_number, 1000> ansi_numbers = make_ansi_numbers();
+
+// the utf-8 bytes of every glyph and the blank, written as a fixed 4 byte copy of which len bytes are kept
+struct ansi_glyph {
+    char bytes[4];
+    unsigned char len;
+};
+
+constexpr std::array<ansi_glyph, ANSI_GLYPHS> make_ansi_glyphs() {
+    std::array<ansi_glyph, ANSI_GLYPHS> glyphs{};
+    for (int g = 0; g < DIFF_CASES; g++) {
+        int len = 0;
+        while (len < 4 && characters[g][len] != '\0') {
+            glyphs[g].bytes[len] = characters[g][len];
+            len++;
+        }
+        glyphs[g].len = static_cast<unsigned char>(len);
+    }
+    glyphs[ANSI_BLANK].bytes[0] = ' ';
+    glyphs[ANSI_BLANK].len = 1;
+    return glyphs;
+}
+
+constexpr std::array<ansi_glyph, ANSI_GLYPHS> ansi_glyphs = make_ansi_glyphs();
+
+// appends escape sequences and glyphs to a caller owned buffer without any formatting or
+// bounds checks. the caller makes sure up front that the buffer has ANSI_MAX_CELL_BYTES
+// for every cell it is going to emit
+//
+// the emitter follows where its output leaves the cursor, so moves can be relative. width is
+// the terminal width: writing the last column leaves a wrap pending, which the next glyph
+// takes to the start of the row below
+//
+// it also follows the colours its output leaves set, which start out unknown unless the caller
+// knows what the terminal has from earlier output
+//
+// with runs enabled, cells which repeat the one printed before them are held back and written
+// as one REP or ECH when that is shorter. flush writes out what is held back, which moves,
+// colours and glyphs that do not join the run do on their own, and the caller does once it is done
+class ansi_emitter {
+public:
+    ansi_emitter(char *buf, int width) : begin(buf), pos(buf), width(width) {}
+
+    // rep repeats the glyph before it with REP (CSI n b), which not every terminal has. ech erases
+    // cells to the background colour with ECH (CSI n X), used when the two colours are the same
+    void use_runs(bool rep_enabled, bool ech_enabled) {
+        rep = rep_enabled;
+        ech = ech_enabled;
+    }
+
+    // where the cursor is before anything is emitted, a negative row when it is not known
+    void set_cursor(int row, int col) {
+        cur_row = row;
+        cur_col = col;
+    }
+
+    [[nodiscard]] int cursor_row() const {
+        return cur_row;
+    }
+
+    // equal to the width while a wrap is pending
+    [[nodiscard]] int cursor_col() const {
+        return cur_col;
+    }
+
+    // the colours the terminal has before anything is emitted, ANSI_SGR_UNKNOWN channels when they are not known
+    void set_sgr(const int bg[3], const int fg[3]) {
+        for (int k = 0; k < 3; k++) {
+            sgr_bg[k] = bg[k];
+            sgr_fg[k] = fg[k];
+        }
+    }
+
+    [[nodiscard]] const int *background_color() const {
+        return sgr_bg;
+    }
+
+    [[nodiscard]] const int *foreground_color() const {
+        return sgr_fg;
+    }
+
+    // moves the cursor to a zero indexed row and column with the shortest sequence that gets there:
+    // an absolute move, or a carriage return and line feeds, or moves down, right or left.
+    // blank_gap is how many cells right before the column show nothing but the background set
+    // now, a short gap of those is written over with blanks, which are shorter than a move.
+    // returns the bytes it took, 0 when the next glyph already lands there
+    int move_to(int row, int col, int blank_gap = 0) {
+        // the next cell in line keeps a run going
+        if (cur_row >= 0 && row == cur_row && col == cur_col) return 0;
+        const int gap = col - cur_col;
+        if (cur_row >= 0 && row == cur_row && gap > 0 && gap <= std::min(blank_gap, ANSI_MAX_OVERPRINT)
+            && sgr_bg[0] != ANSI_SGR_UNKNOWN) {
+            char *start = pos;
+            for (int i = 0; i < gap; i++) glyph(ANSI_BLANK);
+            return static_cast<int>(pos - start);
+        }
+        // a run erased with ECH leaves the cursor at its start, so only after it is written is
+        // it known whether a wrap is pending. the move from there takes the cursor past the run
+        end_run(false);
+        if (cur_row >= 0 && cur_col == width && row == cur_row + 1 && col == 0) return 0;
+
+        char *start = pos;
+        int best = absolute_cost(row, col);
+        int how = MOVE_ABSOLUTE;
+        int down = row - cur_row;
+        if (cur_row >= 0 && down >= 0) {
+            // back to the first column, down and right from there
+            int cost = (cur_col == 0 ? 0 : 1) + std::min(down, relative_cost(down)) + relative_cost(col);
+            if (cost < best) {
+                best = cost;
+                how = MOVE_RETURN;
+            }
+            // down and sideways from the current column, which is not defined while a wrap is pending
+            if (cur_col < width) {
+                cost = relative_cost(down) + relative_cost(std::abs(col - cur_col));
+                if (cost < best) how = MOVE_RELATIVE;
+            }
+        }
+
+        if (how == MOVE_ABSOLUTE) {
+            put("\x1B[", 2);
+            number(row + 1);
+            // the column can be left out when it is the first one
+            if (col > 0) {
+                *pos++ = ';';
+                number(col + 1);
+            }
+            *pos++ = 'H';
+        } else if (how == MOVE_RETURN) {
+            if (cur_col != 0) *pos++ = '\r';
+            // line feeds are shorter for a row or two, the video never reaches the last row so they never scroll
+            if (down <= relative_cost(down)) {
+                for (int i = 0; i < down; i++) *pos++ = '\n';
+            } else {
+                relative(down, 'B');
+            }
+            relative(col, 'C');
+        } else {
+            relative(down, 'B');
+            if (col > cur_col) relative(col - cur_col, 'C');
+            else relative(cur_col - col, 'D');
+        }
+
+        cur_row = row;
+        cur_col = col;
+        return static_cast<int>(pos - start);
+    }
+
+    // colours are bgr, the channel order of the frame
+    void colors(const int bg[3], const int fg[3]) {
+        flush();
+        put("\x1B[48;2;", 7);
+        rgb(bg);
+        put(";38;2;", 6);
+        rgb(fg);
+        *pos++ = 'm';
+        set_sgr(bg, fg);
+    }
+
+    void background(const int bg[3]) {
+        flush();
+        put("\x1B[48;2;", 7);
+        rgb(bg);
+        *pos++ = 'm';
+        for (int k = 0; k < 3; k++) sgr_bg[k] = bg[k];
+    }
+
+    void foreground(const int fg[3]) {
+        flush();
+        put("\x1B[38;2;", 7);
+        rgb(fg);
+        *pos++ = 'm';
+        for (int k = 0; k < 3; k++) sgr_fg[k] = fg[k];
+    }
+
+    // sets only the colours the terminal does not have exactly, returns the bytes it took
+    int restore(const int bg[3], const int fg[3]) {
+        flush();
+        char *start = pos;
+        bool bg_set = same_color(sgr_bg, bg);
+        bool fg_set = same_color(sgr_fg, fg);
+        if (!bg_set && !fg_set) colors(bg, fg);
+        else if (!bg_set) background(bg);
+        else if (!fg_set) foreground(fg);
+        return static_cast<int>(pos - start);
+    }
+
+    // the bytes colors takes for these two colours
+    static int colors_length(const int bg[3], const int fg[3]) {
+        return 14 + rgb_length(bg) + rgb_length(fg);
+    }
+
+    // the bytes background or foreground takes for this colour
+    static int color_length(const int c[3]) {
+        return 8 + rgb_length(c);
+    }
+
+    // g is a glyph of the pixelmap or ANSI_BLANK
+    void glyph(int g) {
+        // a cell right after the last glyph, with nothing emitted in between, joins its run when
+        // it is the same glyph, or when the two colours are the same and every glyph looks alike.
+        // a run does not wrap, so it ends at the last column
+        if ((rep || ech) && pos == glyph_end && cur_row >= 0 && cur_col < width
+            && (g == last_glyph || (same_color(sgr_bg, sgr_fg) && sgr_bg[0] != ANSI_SGR_UNKNOWN))) {
+            run++;
+            cur_col++;
+            return;
+        }
+        flush();
+
+        const ansi_glyph &e = ansi_glyphs[g];
+        memcpy(pos, e.bytes, 4);
+        pos += e.len;
+        last_glyph = g;
+        glyph_end = pos;
+
+        if (cur_row < 0) return;
+        if (cur_col == width) {
+            cur_row++;
+            cur_col = 0;
+        }
+        cur_col++;
+    }
+
+    // writes out the run held back, leaving the cursor at its end where the next cell goes
+    void flush() {
+        end_run(true);
+    }
+
+    // the bytes emitted so far, not counting a run which is still held back
+    [[nodiscard]] int size() const {
+        return static_cast<int>(pos - begin);
+    }
+
+private:
+    enum {
+        MOVE_ABSOLUTE,
+        MOVE_RETURN,
+        MOVE_RELATIVE,
+    };
+
+    enum {
+        RUN_GLYPHS,
+        RUN_REP,
+        RUN_ECH,
+    };
+
+    // writes out the run held back in the cheapest way: the glyph again for every cell, REP of
+    // the glyph, or ECH. with stay the cursor ends up after the run, otherwise ECH leaves it
+    // at the start of the run and the model follows
+    void end_run(bool stay) {
+        if (run == 0) return;
+        const int n = run;
+        run = 0;
+
+        const ansi_glyph &e = ansi_glyphs[last_glyph];
+        int best = n * e.len;
+        int how = RUN_GLYPHS;
+        if (rep && relative_cost(n) < best) {
+            best = relative_cost(n);
+            how = RUN_REP;
+        }
+        // after ECH the next cell needs a move past the run, counted as a move right. a run of
+        // blanks only shows the background even when the colours differ
+        if (ech && (last_glyph == ANSI_BLANK || same_color(sgr_bg, sgr_fg)) && 2 * relative_cost(n) < best
+            && (!stay || cur_col < width))
+            how = RUN_ECH;
+
+        if (how == RUN_GLYPHS) {
+            for (int i = 0; i < n; i++) {
+                memcpy(pos, e.bytes, 4);
+                pos += e.len;
+            }
+        } else if (how == RUN_REP) {
+            relative(n, 'b');
+        } else {
+            relative(n, 'X');
+            // the cell after the run may already be where the caller moved to, a pending wrap
+            // can not be restored so such runs are not erased when staying
+            if (stay) relative(n, 'C');
+            else cur_col -= n;
+        }
+    }
+
+    static int digits(int v) {
+        return v < 10 ? 1 : v < 100 ? 2 : v < 1000 ? 3 : v < 10000 ? 4 : 5;
+    }
+
+    static bool same_color(const int a[3], const int b[3]) {
+        return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+    }
+
+    static int rgb_length(const int c[3]) {
+        return 2 + digits(c[0]) + digits(c[1]) + digits(c[2]);
+    }
+
+    static int absolute_cost(int row, int col) {
+        return 3 + digits(row + 1) + (col > 0 ? 1 + digits(col + 1) : 0);
+    }
+
+    // a relative move by n, the count is left out when it is 1
+    static int relative_cost(int n) {
+        return n == 0 ? 0 : n == 1 ? 3 : 3 + digits(n);
+    }
+
+    void relative(int n, char dir) {
+        if (n == 0) return;
+        put("\x1B[", 2);
+        if (n > 1) number(n);
+        *pos++ = dir;
+    }
+
+    void put(const char *s, int len) {
+        memcpy(pos, s, len);
+        pos += len;
+    }
+
+    void number(int v) {
+        if (v < 1000) {
+            const ansi_number &n = ansi_numbers[v];
+            memcpy(pos, n.text, 3);
+            pos += n.len;
+            return;
+        }
+        // only cursor coordinates of very wide terminals get here
+        char digits[10];
+        int len = 0;
+        for (; v > 0; v /= 10) digits[len++] = static_cast<char>('0' + v % 10);
+        while (len > 0) *pos++ = digits[--len];
+    }
+
+    void rgb(const int c[3]) {
+        number(c[2]);
+        *pos++ = ';';
+        number(c[1]);
+        *pos++ = ';';
+        number(c[0]);
+    }
+
+    char *begin;
+    char *pos;
+    int width;
+    int cur_row = -1;
+    int cur_col = 0;
+    int sgr_bg[3] = {ANSI_SGR_UNKNOWN, ANSI_SGR_UNKNOWN, ANSI_SGR_UNKNOWN};
+    int sgr_fg[3] = {ANSI_SGR_UNKNOWN, ANSI_SGR_UNKNOWN, ANSI_SGR_UNKNOWN};
+    bool rep = false;
+    bool ech = false;
+    // the last glyph printed, where its bytes end and how many cells repeat it after that
+    int last_glyph = 0;
+    const char *glyph_end = nullptr;
+    int run = 0;
+};
+
+#endif //TVP_ANSI_EMITTER_H
@@ -0,0 +1,62 @@
+#ifndef TVP_AUDIO_RING_H
+#define TVP_AUDIO_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// fixed capacity single producer, single consumer byte ring for decoded audio
+// the decode thread writes resampled audio straight into it and the sdl callback
+// reads straight out of it, neither side allocates or takes a lock. a full ring is
+// waited out on an atomic the consumer bumps, the lock free form of a condition variable
+class audio_ring {
+public:
+    audio_ring() = default;
+
+    ~audio_ring();
+
+    audio_ring(const audio_ring &) = delete;
+
+    audio_ring &operator=(const audio_ring &) = delete;
+
+    // capacity is rounded down to a whole number of frames of frame_bytes, must not
+    // be called while either side is running
+    bool allocate(size_t capacity, size_t frame_bytes);
+
+    void release();
+
+    [[nodiscard]] size_t capacity() const;
+
+    // producer side: free space, and the free region starting at the write position split into
+    // the part before the end of the ring and the part wrapped around to the start
+    [[nodiscard]] size_t writable() const;
+
+    // blocks until n bytes are writable, false once the ring was aborted
+    bool wait_writable(size_t n);
+
+    // fails every wait_writable from now on, used on shutdown
+    void abort();
+
+    void write_regions(uint8_t *&first, size_t &first_len, uint8_t *&second, size_t &second_len) const;
+
+    // publish n bytes written into the regions
+    void commit(size_t n);
+
+    // consumer side: copy out up to n bytes, returns the number of bytes copied
+    size_t read(uint8_t *dst, size_t n);
+
+    [[nodiscard]] size_t readable() const;
+
+private:
+    uint8_t *data = nullptr;
+    size_t size = 0;
+    // only ever grow, positions in the ring are taken modulo the size
+    // head is written by the consumer only and tail by the producer only
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    // bumped by every read and by abort
+    alignas(64) std::atomic<uint32_t> freed{0};
+    std::atomic<bool> aborted{false};
+};
+
+#endif //TVP_AUDIO_RING_H
@@ -0,0 +1,95 @@
+#ifndef TVP_AVIO_SOURCE_H
+#define TVP_AVIO_SOURCE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// size of the buffer avformat reads through
+#define AVIO_BUFFER_SIZE (64 * 1024)
+// bytes of stdin buffered ahead of the demuxer
+#define AVIO_PIPE_RING_SIZE (64 << 20)
+// bytes of a mapped file the kernel is asked to read ahead of the demuxer
+#define AVIO_MMAP_READAHEAD (8 << 20)
+
+// custom input for avformat, regular files are memory mapped and pipes are
+// drained by a reader thread into a large ring, so a slow upstream or a slow
+// mount shows up as io wait instead of stalling the demuxer on every read
+class avio_source {
+public:
+    enum backend {
+        BACKEND_NONE,
+        BACKEND_MMAP,
+        BACKEND_PIPE,
+    };
+
+    // if the source cannot be opened, avformat should open the input itself
+    avio_source(const char filename[], bool is_pipe);
+
+    ~avio_source();
+
+    avio_source(const avio_source &) = delete;
+
+    avio_source &operator=(const avio_source &) = delete;
+
+    [[nodiscard]] bool is_opened() const;
+
+    // stops the pipe reader and fails reads that wait for input, so a demuxer stuck
+    // on a stalled pipe returns. called before the threads using the source are joined
+    void abort();
+
+    [[nodiscard]] AVIOContext *get_context() const;
+
+    [[nodiscard]] backend get_backend() const;
+
+    [[nodiscard]] const char *get_backend_name() const;
+
+    // time the demuxer spent waiting for input, in microseconds
+    [[nodiscard]] long long get_wait_time() const;
+
+    [[nodiscard]] long long get_bytes_read() const;
+
+private:
+    static int read_packet(void *opaque, uint8_t *buf, int size);
+
+    static int64_t seek(void *opaque, int64_t offset, int whence);
+
+    int read_mmap(uint8_t *buf, int size);
+
+    // whether the pages of the mapping in the range are in memory
+    [[nodiscard]] bool is_resident(int64_t from, int64_t len) const;
+
+    int read_pipe(uint8_t *buf, int size);
+
+    void reader_loop();
+
+    backend type = BACKEND_NONE;
+    AVIOContext *ctx = nullptr;
+
+    // mmap backend
+    int fd = -1;
+    uint8_t *map = nullptr;
+    int64_t map_size = 0;
+    int64_t pos = 0;
+    int64_t readahead_until = 0;
+
+    // pipe backend, head and tail only ever grow, the ring index is taken modulo the size
+    uint8_t *ring = nullptr;
+    int64_t head = 0, tail = 0;
+    bool input_done = false;
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+    std::thread reader;
+    bool running = false;
+
+    std::atomic<long long> wait_time{0};
+    std::atomic<long long> bytes_read{0};
+};
+
+#endif //TVP_AVIO_SOURCE_H
@@ -0,0 +1,67 @@
+#ifndef TVP_FRAME_ARENA_H
+#define TVP_FRAME_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+
+// alignment of the arena and of every buffer carved out of it
+#define FRAME_ARENA_ALIGN 64
+// arenas at least this big are aligned to it, so they can be backed by transparent huge pages
+#define FRAME_ARENA_HUGE_PAGE (2 * 1024 * 1024)
+
+// what one terminal cell shows, the glyph and its two colours in the channel order of the
+// decoded frame (bgr, or yuv for planar frames). the pixels on screen are the glyph mask
+// expanded with these colours, so this is all the diff stage needs to remember
+struct screen_cell {
+    uint8_t glyph;
+    uint8_t fg[3];
+    uint8_t bg[3];
+    uint8_t pad;
+};
+
+static_assert(sizeof(screen_cell) == 8, "the opencl kernel reads screen cells as 8 bytes");
+
+// every buffer the render loop needs for one output geometry, carved out of a single
+// zeroed allocation. a resize builds a new arena and swaps it in, there is no partial
+// reallocation to roll back
+class frame_arena {
+public:
+    // print_bytes is the size of each print buffer and cells the number of terminal cells
+    // gpu_cells is the number of cells with opencl results, 0 leaves those buffers out
+    frame_arena(size_t print_bytes, size_t cells, size_t gpu_cells, bool huge_pages);
+
+    ~frame_arena();
+
+    frame_arena(const frame_arena &) = delete;
+
+    frame_arena &operator=(const frame_arena &) = delete;
+
+    [[nodiscard]] bool is_allocated() const;
+
+    [[nodiscard]] size_t get_size() const;
+
+    // whether the kernel was asked to back the arena with huge pages
+    [[nodiscard]] bool uses_huge_pages() const;
+
+    // what is on screen, one entry per cell
+    screen_cell *screen = nullptr;
+    // ansi output of the render loop and the copy handed to the write thread
+    char *print_buf = nullptr;
+    char *render_buffer = nullptr;
+    // dithering error, 3 channels per cell, and the error held back at band seams
+    float *error_buffer = nullptr;
+    float *dither_carry = nullptr;
+    // glyph used per cell, also used for the character usage stats
+    int *char_indices = nullptr;
+    // opencl results per cell
+    int *fg_colors = nullptr;
+    int *bg_colors = nullptr;
+    bool *needs_update = nullptr;
+
+private:
+    char *base = nullptr;
+    size_t size = 0;
+    bool huge = false;
+};
+
+#endif //TVP_FRAME_ARENA_H
@@ -0,0 +1,91 @@
+#ifndef TVP_FRAME_QUEUE_H
+#define TVP_FRAME_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "video.h"
+
+// bounded ring of pre-scaled frames filled by a dedicated decode thread
+// the render loop only pops frames which are already decoded and scaled,
+// so decode latency spikes (keyframes, slow io) are absorbed by the ring
+class frame_queue {
+public:
+    frame_queue(video &cap, int depth);
+
+    ~frame_queue();
+
+    void start();
+
+    void stop();
+
+    // abort the input and stop, used on shutdown where the decode thread
+    // may be waiting on a stalled input and would never see the stop
+    void abort();
+
+    // request a new output size, frames already decoded at the old size are discarded
+    void resize(int w, int h);
+
+    // blocks until the next frame is ready and lends it out without copying
+    // the frame stays valid until the next call to pop or skip
+    // returns the same values as video::get_frame, on 1 dst is left untouched
+    int pop(int dst_w, int dst_h, frame_buffer &dst);
+
+    // drop the next n frames without handing them to the renderer
+    // this also returns the frame lent out by the last pop
+    void skip(int n);
+
+    [[nodiscard]] bool is_end_of_stream() const;
+
+    [[nodiscard]] int size();
+
+    [[nodiscard]] int capacity() const;
+
+    // time the render loop spent waiting for a frame, in microseconds
+    [[nodiscard]] long long get_last_stall_time() const;
+
+    [[nodiscard]] long long get_total_stall_time() const;
+
+    // time the decode thread spent in video::get_frame, in microseconds
+    [[nodiscard]] long long get_last_decode_time() const;
+
+    [[nodiscard]] long long get_total_decode_time() const;
+
+private:
+    struct slot {
+        frame_buffer buf;
+        int ret = 0;
+        bool end_of_stream = false;
+    };
+
+    void decode_loop();
+
+    video &cap;
+    // one slot more than the depth, so a full ring and a lent out frame can coexist
+    std::vector<slot> slots;
+    int depth;
+    int head = 0, tail = 0, count = 0;
+    int borrowed = -1;
+
+    std::mutex mutex;
+    std::condition_variable not_empty, not_full;
+    std::thread thread;
+    bool running = false;
+
+    // requested output size, bumping the generation invalidates in-flight frames
+    int req_width = -1, req_height = -1;
+    bool resize_pending = false;
+    unsigned generation = 0;
+    int pending_skip = 0;
+    bool producer_done = false;
+
+    bool end_of_stream = false;
+
+    long long last_stall_time = 0, total_stall_time = 0;
+    std::atomic<long long> last_decode_time{0}, total_decode_time{0};
+};
+
+#endif //TVP_FRAME_QUEUE_H
@@ -0,0 +1,22 @@
+#ifndef TVP_GLYPH_FIT_H
+#define TVP_GLYPH_FIT_H
+
+#include <cstdint>
+
+// samples per cell the glyph fit works on, CHAR_Y * CHAR_X
+#define GLYPH_FIT_PIXELS 64
+
+// scores glyphs 0 to glyphs - 1 for one cell. samples holds the cell's pixels row by row,
+// one plane per channel. cases[g] is the largest spread of any channel within either the
+// foreground or the background region of glyph g, the lowest score fits best
+void glyph_fit_minimax(const uint8_t samples[][GLYPH_FIT_PIXELS], int channels, int glyphs, int *cases);
+
+// picks the glyph among glyphs 0 to glyphs - 1 with the smallest squared error when its
+// foreground and background are each filled with their mean, as the opencl kernel does.
+// samples are laid out as for glyph_fit_minimax, at most 3 channels, ideally in linear light
+int glyph_fit_mse(const float samples[][GLYPH_FIT_PIXELS], int channels, int glyphs);
+
+// the instruction set glyph_fit_minimax runs on, picked once at startup
+const char *glyph_fit_backend();
+
+#endif //TVP_GLYPH_FIT_H
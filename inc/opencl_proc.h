@@ -28,10 +28,9 @@ public:
   std::string getDeviceName() const { return device_name; }
 
   // Process entire frame on GPU
+  // what is on screen is kept on the device between frames, one 8 byte cell state per character
   void processFrame(
     const char *frame,
-    const char *old_frame,
-    char *output_frame,
     int width,
     int height,
     int char_width,
@@ -43,7 +42,12 @@ public:
     int *char_indices, // which character to use
     int *fg_colors, // RGB foreground colors (packed)
     int *bg_colors, // RGB background colors (packed)
-    bool *needs_update // which characters need updating
+    bool *needs_update, // which characters need updating
+    // size of one character cell in frame pixels
+    int cell_w,
+    int cell_h,
+    // bytes per row of frame
+    int stride
   );
 
 private:
@@ -57,14 +61,12 @@ private:
 
   // Device memory buffers
   cl_mem d_frame = nullptr;
-  cl_mem d_old_frame = nullptr;
-  cl_mem d_output_frame = nullptr;
+  cl_mem d_screen = nullptr;
   cl_mem d_error_buffer = nullptr;
   cl_mem d_char_indices = nullptr;
   cl_mem d_fg_colors = nullptr;
   cl_mem d_bg_colors = nullptr;
   cl_mem d_needs_update = nullptr;
-  cl_mem d_pixelmap = nullptr;
 
   size_t current_buffer_size = 0;
   size_t current_grid_size = 0;
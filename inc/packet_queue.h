@@ -0,0 +1,70 @@
+#ifndef TVP_PACKET_QUEUE_H
+#define TVP_PACKET_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// a stream has enough packets queued once it holds this many and this much time
+#define PACKET_QUEUE_MIN_PACKETS 25
+#define PACKET_QUEUE_MIN_DURATION 1.0
+
+// lets one thread wait for room in several packet queues at once, every get and abort of a
+// queue attached to it signals freed
+struct packet_space {
+    std::mutex mutex;
+    std::condition_variable freed;
+};
+
+// queue of demuxed packets for one stream, filled by the demux thread and drained by that
+// stream's decoder. put never blocks, the demux thread limits itself through is_enough and bytes
+// and waits on the packet_space of the queues while they are full
+class packet_queue {
+public:
+    packet_queue() = default;
+
+    ~packet_queue();
+
+    packet_queue(const packet_queue &) = delete;
+
+    packet_queue &operator=(const packet_queue &) = delete;
+
+    // moves the packet's data into the queue, pkt is left blank
+    bool put(AVPacket *pkt);
+
+    // no more packets will be put, get returns 0 once the queue has drained
+    void put_eof();
+
+    // blocks until a packet is available and moves it into pkt
+    // returns 1 for a packet, 0 at the end of the stream and -1 once aborted
+    int get(AVPacket *pkt);
+
+    // wakes up and fails every get, used on shutdown
+    void abort();
+
+    // signal space whenever packets are taken out or the queue is aborted
+    void set_space(packet_space *s);
+
+    [[nodiscard]] bool is_enough(AVRational time_base);
+
+    [[nodiscard]] long long bytes();
+
+private:
+    void signal_space();
+
+    std::deque<AVPacket *> packets;
+    long long total_bytes = 0;
+    int64_t total_duration = 0;
+    bool eof = false;
+    bool aborted = false;
+
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    packet_space *space = nullptr;
+};
+
+#endif //TVP_PACKET_QUEUE_H
@@ -1,8 +1,15 @@
+#ifndef TVP_PIXELMAP_H
+#define TVP_PIXELMAP_H
+
+#include <array>
+#include <bit>
+#include <cstdint>
+
 #define CHAR_Y 8
 #define CHAR_X 8
 #define DIFF_CASES 44
 
-[[maybe_unused]] const char characters[DIFF_CASES][4] = {
+[[maybe_unused]] constexpr char characters[DIFF_CASES][4] = {
  "\u2584", // bottom half block
  "\u2590", // right half block
  "\u2598", // top left quarter
@@ -23,7 +30,7 @@
  "\u258b", // left 5/8 vertical
  "\u2589", // left 7/8 vertical
 
- // OpenCL only characters
+ // OpenCL and --cpu-mse only characters
  "\u2501", // thick horizontal middle line
  "\u2503", // thick vertical center line
  "\u25a0", // center square
@@ -51,7 +58,7 @@
  "\u2573", // corner to corner cross shape
 };
 
-const int pixelmap[DIFF_CASES][CHAR_Y * CHAR_X] = {
+constexpr int pixelmap[DIFF_CASES][CHAR_Y * CHAR_X] = {
  // bottom half block
  {0, 0, 0, 0, 0, 0, 0, 0,
   0, 0, 0, 0, 0, 0, 0, 0,
@@ -491,4 +498,32 @@ const int pixelmap[DIFF_CASES][CHAR_Y * CHAR_X] = {
   0, 0, 1, 0, 0, 1, 0, 0,
   0, 1, 0, 0, 0, 0, 1, 0,
   1, 0, 0, 0, 0, 0, 0, 1},
-};
\ No newline at end of file
+};
+
+static_assert(CHAR_Y * CHAR_X == 64, "glyph masks hold one cell in a 64 bit word");
+
+// the glyphs packed one bit per pixel, bit i * CHAR_X + j is set for foreground pixels
+constexpr std::array<uint64_t, DIFF_CASES> make_glyph_masks() {
+    std::array<uint64_t, DIFF_CASES> masks{};
+    for (int g = 0; g < DIFF_CASES; g++)
+        for (int p = 0; p < CHAR_Y * CHAR_X; p++)
+            if (pixelmap[g][p]) masks[g] |= uint64_t{1} << p;
+    return masks;
+}
+
+constexpr std::array<uint64_t, DIFF_CASES> glyph_masks = make_glyph_masks();
+
+// foreground pixels of every glyph, the background has the rest
+constexpr std::array<int, DIFF_CASES> make_glyph_fg_counts() {
+    std::array<int, DIFF_CASES> counts{};
+    for (int g = 0; g < DIFF_CASES; g++) counts[g] = std::popcount(glyph_masks[g]);
+    return counts;
+}
+
+constexpr std::array<int, DIFF_CASES> glyph_fg_count = make_glyph_fg_counts();
+
+constexpr bool glyph_is_fg(int glyph, int p) {
+    return (glyph_masks[glyph] >> p) & 1;
+}
+
+#endif //TVP_PIXELMAP_H
@@ -16,13 +16,86 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 #include <libswresample/swresample.h>
+#include <libavutil/opt.h>
 }
 
+#include <atomic>
+#include <thread>
+
+#include "avio_source.h"
+#include "packet_queue.h"
+
+// sliced multithreaded scaling through sws_scale_frame (ffmpeg 5.0+)
+#define SWS_HAS_THREADS (LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100))
+
+// decoder quality levels, each level includes the shortcuts of the previous one
+// 0: full quality
+// 1: skip the loop filter on non-reference frames
+// 2: skip the loop filter on all frames and the idct on non-reference frames
+// 3: also decode at reduced resolution (lowres) if the codec supports it
+#define DECODE_QUALITY_AUTO (-1)
+#define DECODE_QUALITY_MAX 3
+
+// decoder threading, a thread count of 0 picks one from the number of cores
+#define DECODE_THREADS_AUTO 0
+// most decoder threads the automatic count picks
+#define DECODE_THREADS_MAX 16
+#define DECODE_THREAD_TYPE_AUTO 0
+#define SCALE_THREADS_AUTO 0
+
+// probe limits for fast start, missing stream info is filled in from the first decoded frame
+#define FAST_START_PROBESIZE "65536"
+#define FAST_START_ANALYZEDURATION "100000"
+#define FALLBACK_FPS 25.0
+
+// milliseconds of resampled audio buffered ahead of the sdl callback
+#define AUDIO_RING_MS 500
+
+// the demux thread stops reading ahead once all packet queues together hold this much
+#define PACKET_QUEUES_MAX_BYTES (15 * 1024 * 1024)
+
+struct video_options {
+    bool enable_audio = true;
+    // decoder quality level, or DECODE_QUALITY_AUTO to pick one from the output size
+    int decode_quality = DECODE_QUALITY_AUTO;
+    // box the video will be fitted into, used to pick the quality before the first resize
+    int target_width = -1;
+    int target_height = -1;
+    // libavcodec threading, thread_type is FF_THREAD_FRAME, FF_THREAD_SLICE or both (auto)
+    int decode_threads = DECODE_THREADS_AUTO;
+    int decode_thread_type = DECODE_THREAD_TYPE_AUTO;
+    // number of horizontal slices sws_scale is split into
+    int scale_threads = SCALE_THREADS_AUTO;
+    // keep the decoder's planar yuv (4:2:0 or 4:4:4) instead of converting to bgr24
+    bool planar_yuv = false;
+    // probe as little of the input as possible before decoding starts
+    bool fast_start = false;
+};
+
+// row alignment of the frames handed to the renderer
+#define FRAME_BUFFER_ALIGN 64
+
+// caller owned destination for a decoded frame, the scaler writes into the planes directly
+// bgr24 frames use plane 0 only, planar yuv frames use planes 0-2 of one allocation
+struct frame_buffer {
+    uint8_t *data[4] = {};
+    int linesize[4] = {};
+    int width = 0;
+    int height = 0;
+    // presentation time of the frame held in the planes, in seconds from the start of the stream
+    double pts = 0;
+};
+
 class video {
 public:
-    video(const char filename[], int w, int h, bool enable_audio = true);
+    video(const char filename[], int w, int h, const video_options &opts);
+
+    video(const char filename[], int w, int h, bool enable_audio = true)
+        : video(filename, w, h, video_options{.enable_audio = enable_audio}) {
+    };
 
     explicit video(const char filename[]) : video(filename, -1, -1, true) {
     };
@@ -31,6 +104,9 @@ public:
 
     void setResize(int w, int h);
 
+    // swscale filter used by setResize, takes effect on the next resize
+    void set_scale_flags(int flags);
+
     [[nodiscard]] bool isOpened() const;
 
     [[nodiscard]] double get_fps() const;
@@ -41,9 +117,54 @@ public:
 
     [[nodiscard]] int get_dst_buf_size() const;
 
+    [[nodiscard]] static int get_dst_buf_size(int w, int h, AVPixelFormat fmt = AV_PIX_FMT_BGR24);
+
+    [[nodiscard]] static int get_dst_stride(int w);
+
+    // point the planes of fb into base with the layout get_frame expects, returns the total size
+    static int wrap_frame_buffer(frame_buffer &fb, uint8_t *base, int w, int h, AVPixelFormat fmt);
+
+    // allocate an aligned buffer with the stride get_frame expects
+    static bool alloc_frame_buffer(frame_buffer &fb, int w, int h, AVPixelFormat fmt = AV_PIX_FMT_BGR24);
+
+    static void free_frame_buffer(frame_buffer &fb);
+
     [[nodiscard]] bool is_end_of_stream() const;
 
-    int get_frame(int dst_w, int dst_h, const char *dst_frame);
+    [[nodiscard]] int get_decode_quality() const;
+
+    [[nodiscard]] int get_lowres() const;
+
+    // effective decoder threading after the codec was opened
+    [[nodiscard]] int get_decode_threads() const;
+
+    [[nodiscard]] int get_decode_thread_type() const;
+
+    [[nodiscard]] int get_scale_threads() const;
+
+    // input backend and the time the demuxer spent waiting for input, in microseconds
+    [[nodiscard]] const char *get_io_backend_name() const;
+
+    [[nodiscard]] long long get_io_wait_time() const;
+
+    // pixel format of the frames handed out by get_frame
+    [[nodiscard]] AVPixelFormat get_dst_pix_fmt() const;
+
+    // yuv matrix of planar frames, unspecified matrices are guessed from the source height
+    [[nodiscard]] AVColorSpace get_colorspace() const;
+
+    // decode the next frame and scale it into dst, which must match the current output size
+    int get_frame(const frame_buffer &dst);
+
+    // presentation time of the frame returned by the last get_frame, in seconds from the start of the stream
+    [[nodiscard]] double get_frame_pts() const;
+
+    // advance n frames without scaling or copying them, returns the number of frames skipped
+    int skip_frames(int n);
+
+    // stop the demux and audio threads and abort the input, so a get_frame waiting
+    // on a stalled input returns -1, may be called from any thread
+    void abort();
 
     // audio methods
     [[nodiscard]] bool has_audio() const;
@@ -52,7 +173,34 @@ public:
 
     [[nodiscard]] int get_audio_channels() const;
 
+    // audio is opened paused so playback can start together with the first video frame
+    void start_audio();
+
+    // position of the audio that is currently audible, in seconds from the start of the stream
+    // returns false without audio, before playback starts, and while the audio has run dry
+    bool get_audio_clock(double &clock) const;
+
 private:
+    // takes the next video packet from the demux thread and sends it to the decoder
+    // returns 1 for a packet, 0 at the end of the stream and -1 on shutdown
+    int demux_packet();
+
+    // reads packets into the per-stream queues until the end of the input
+    void demux_loop();
+
+    // decodes and resamples audio packets into the audio ring
+    void audio_loop();
+
+    // resamples audio_frame into the audio ring, waiting for room, returns false on shutdown
+    bool write_audio_frame();
+
+    void apply_decode_quality(int level);
+
+    // decode up to the first frame, used when the probe did not find the frame size
+    // the frame is kept in decframe and handed out by the next get_frame
+    bool decode_first_frame();
+
+    avio_source *io = nullptr;
     AVFormatContext *inctx = nullptr;
     AVCodecContext *codec = nullptr;
     const AVCodec *vcodec = nullptr;
@@ -65,16 +213,32 @@ private:
 
     int src_width;
     int src_height;
+
+    bool decode_quality_auto = true;
+    int decode_quality = 0;
     int dst_width;
     int dst_height;
 
     AVFrame *decframe = nullptr;
     bool end_of_stream_pkt = false, end_of_stream_enc = false;
+    bool pending_frame = false;
+
+    // start of the stream, subtracted from every timestamp, and the time of the last video frame
+    double stream_start = 0;
+    double frame_pts = 0;
     AVPacket *pkt = nullptr;
 
-    bool alloc = false;
+    // demux thread and the packets it hands to the video and audio decoders
+    AVPacket *demux_pkt = nullptr;
+    packet_queue video_packets, audio_packets;
+    // signalled as the decoders take packets, the demux thread waits on it while the queues are full
+    packet_space queue_space;
+    std::thread demux_thread, audio_thread;
+    std::atomic<bool> threads_running{false};
 
-    const AVPixelFormat dst_pix_fmt = AV_PIX_FMT_BGR24;
+    AVPixelFormat dst_pix_fmt = AV_PIX_FMT_BGR24;
+    int sws_flags = SWS_BICUBIC;
+    int scale_threads = 1;
     char errbuf[200]{};
 
     // audio handling members
@@ -85,6 +249,7 @@ private:
     AVFrame *audio_frame = nullptr;
     SwrContext *swr_ctx = nullptr;
     bool audio_available = false;
+    char audio_errbuf[200]{};
 
     friend void audio_callback(void *userdata, uint8_t *stream, int len);
 };
@@ -0,0 +1,49 @@
+#ifndef TVP_WORKER_POOL_H
+#define TVP_WORKER_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// persistent threads which run batches of numbered jobs, the calling thread takes part
+// in every batch so a pool of n threads runs jobs on n + 1 threads
+class worker_pool {
+public:
+    explicit worker_pool(int threads);
+
+    ~worker_pool();
+
+    worker_pool(const worker_pool &) = delete;
+
+    worker_pool &operator=(const worker_pool &) = delete;
+
+    // runs job(0) to job(jobs - 1) and returns once every one of them has finished
+    void run(int jobs, const std::function<void(int)> &job);
+
+    // number of threads a batch runs on, including the caller
+    [[nodiscard]] int concurrency() const;
+
+private:
+    void worker_loop();
+
+    // claims the next job of the given batch, -1 once there are none left or it is over
+    int claim_job(unsigned long long of_batch);
+
+    void finish_job();
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+
+    const std::function<void(int)> *current = nullptr;
+    int total_jobs = 0;
+    int next_job = 0;
+    int unfinished = 0;
+    unsigned long long batch = 0;
+    bool stopping = false;
+};
+
+#endif //TVP_WORKER_POOL_H
@@ -0,0 +1,90 @@
+#include "audio_ring.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+audio_ring::~audio_ring() {
+    release();
+}
+
+bool audio_ring::allocate(size_t capacity, size_t frame_bytes) {
+    release();
+    // whole frames only, so a write region never ends in the middle of a frame
+    if (frame_bytes > 0) capacity -= capacity % frame_bytes;
+    if (capacity == 0) return false;
+
+    data = static_cast<uint8_t *>(std::malloc(capacity));
+    if (!data) return false;
+    size = capacity;
+    head.store(0);
+    tail.store(0);
+    aborted.store(false);
+    return true;
+}
+
+void audio_ring::release() {
+    std::free(data);
+    data = nullptr;
+    size = 0;
+    head.store(0);
+    tail.store(0);
+}
+
+size_t audio_ring::capacity() const {
+    return size;
+}
+
+size_t audio_ring::writable() const {
+    return size - static_cast<size_t>(tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire));
+}
+
+bool audio_ring::wait_writable(size_t n) {
+    while (true) {
+        // a read after this load changes freed, so the wait below can not miss it
+        uint32_t seen = freed.load(std::memory_order_acquire);
+        if (aborted.load()) return false;
+        if (writable() >= n) return true;
+        freed.wait(seen, std::memory_order_acquire);
+    }
+}
+
+void audio_ring::abort() {
+    aborted.store(true);
+    freed.fetch_add(1, std::memory_order_release);
+    freed.notify_all();
+}
+
+void audio_ring::write_regions(uint8_t *&first, size_t &first_len, uint8_t *&second, size_t &second_len) const {
+    size_t free_bytes = writable();
+    size_t start = static_cast<size_t>(tail.load(std::memory_order_relaxed) % size);
+    first = data + start;
+    first_len = std::min(free_bytes, size - start);
+    second = data;
+    second_len = free_bytes - first_len;
+}
+
+void audio_ring::commit(size_t n) {
+    tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+}
+
+size_t audio_ring::readable() const {
+    return static_cast<size_t>(tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed));
+}
+
+size_t audio_ring::read(uint8_t *dst, size_t n) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    n = std::min(n, static_cast<size_t>(tail.load(std::memory_order_acquire) - h));
+    if (n == 0) return 0;
+
+    // copy out in at most two pieces when the data wraps around the end of the ring
+    size_t start = static_cast<size_t>(h % size);
+    size_t first = std::min(n, size - start);
+    memcpy(dst, data + start, first);
+    if (first < n) memcpy(dst + first, data, n - first);
+
+    head.store(h + n, std::memory_order_release);
+    freed.fetch_add(1, std::memory_order_release);
+    freed.notify_one();
+    return n;
+}
@@ -0,0 +1,281 @@
+#include "avio_source.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+avio_source::avio_source(const char filename[], bool is_pipe) {
+    if (is_pipe) {
+        ring = static_cast<uint8_t *>(av_malloc(AVIO_PIPE_RING_SIZE));
+        if (!ring) return;
+        type = BACKEND_PIPE;
+    } else {
+#if defined(_WIN32)
+        // no mapping on windows, avformat reads the file itself
+        (void) filename;
+        return;
+#else
+        fd = open(filename, O_RDONLY);
+        if (fd < 0) return;
+
+        struct stat st{};
+        if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+            close(fd);
+            fd = -1;
+            return;
+        }
+
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            fd = -1;
+            return;
+        }
+        map = static_cast<uint8_t *>(addr);
+        map_size = st.st_size;
+        // the demuxer mostly reads front to back, let the kernel read ahead aggressively
+        madvise(map, map_size, MADV_SEQUENTIAL);
+        type = BACKEND_MMAP;
+#endif
+    }
+
+    auto *buffer = static_cast<uint8_t *>(av_malloc(AVIO_BUFFER_SIZE));
+    if (buffer) {
+        ctx = avio_alloc_context(buffer, AVIO_BUFFER_SIZE, 0, this, read_packet, nullptr,
+                                 type == BACKEND_MMAP ? seek : nullptr);
+    }
+    if (!ctx) {
+        av_free(buffer);
+        type = BACKEND_NONE;
+        return;
+    }
+    ctx->seekable = type == BACKEND_MMAP ? AVIO_SEEKABLE_NORMAL : 0;
+
+    if (type == BACKEND_PIPE) {
+        running = true;
+        reader = std::thread(&avio_source::reader_loop, this);
+    }
+}
+
+avio_source::~avio_source() {
+    abort();
+    if (reader.joinable()) reader.join();
+
+    if (ctx) {
+        av_freep(&ctx->buffer);
+        avio_context_free(&ctx);
+    }
+    av_freep(&ring);
+#if !defined(_WIN32)
+    if (map) munmap(map, map_size);
+    if (fd >= 0) close(fd);
+#endif
+}
+
+void avio_source::abort() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    not_full.notify_all();
+    not_empty.notify_all();
+}
+
+bool avio_source::is_opened() const {
+    return type != BACKEND_NONE;
+}
+
+AVIOContext *avio_source::get_context() const {
+    return ctx;
+}
+
+avio_source::backend avio_source::get_backend() const {
+    return type;
+}
+
+const char *avio_source::get_backend_name() const {
+    switch (type) {
+        case BACKEND_MMAP:
+            return "mmap";
+        case BACKEND_PIPE:
+            return "pipe read-ahead";
+        default:
+            return "avformat";
+    }
+}
+
+long long avio_source::get_wait_time() const {
+    return wait_time.load();
+}
+
+long long avio_source::get_bytes_read() const {
+    return bytes_read.load();
+}
+
+int avio_source::read_packet(void *opaque, uint8_t *buf, int size) {
+    auto *src = static_cast<avio_source *>(opaque);
+    return src->type == BACKEND_MMAP ? src->read_mmap(buf, size) : src->read_pipe(buf, size);
+}
+
+int64_t avio_source::seek(void *opaque, int64_t offset, int whence) {
+    auto *src = static_cast<avio_source *>(opaque);
+    switch (whence & ~AVSEEK_FORCE) {
+        case AVSEEK_SIZE:
+            return src->map_size;
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += src->pos;
+            break;
+        case SEEK_END:
+            offset += src->map_size;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+    if (offset < 0) return AVERROR(EINVAL);
+    src->pos = offset;
+    // restart the read-ahead window from the new position
+    src->readahead_until = offset;
+    return offset;
+}
+
+int avio_source::read_mmap(uint8_t *buf, int size) {
+    if (pos >= map_size) return AVERROR_EOF;
+    int n = static_cast<int>(std::min<int64_t>(size, map_size - pos));
+
+#if !defined(_WIN32)
+    // keep a window of pages in flight ahead of the demuxer, refreshed once half of it is used
+    if (pos + n > readahead_until - AVIO_MMAP_READAHEAD / 2) {
+        static const int64_t page = sysconf(_SC_PAGESIZE);
+        int64_t from = std::max(pos, readahead_until) / page * page;
+        int64_t len = std::min<int64_t>(AVIO_MMAP_READAHEAD, map_size - from);
+        if (len > 0) madvise(map + from, len, MADV_WILLNEED);
+        readahead_until = from + len;
+    }
+#endif
+
+    // page faults on pages which have not arrived yet land in the copy, which is only
+    // counted as io wait then, a copy out of pages already in memory is not waiting
+    if (is_resident(pos, n)) {
+        memcpy(buf, map + pos, n);
+    } else {
+        auto copy_start = std::chrono::steady_clock::now();
+        memcpy(buf, map + pos, n);
+        wait_time += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - copy_start).count();
+    }
+
+    pos += n;
+    bytes_read += n;
+    return n;
+}
+
+bool avio_source::is_resident(int64_t from, int64_t len) const {
+#if defined(_WIN32)
+    (void) from;
+    (void) len;
+    return true;
+#else
+    static const int64_t page = sysconf(_SC_PAGESIZE);
+#if defined(__APPLE__)
+    char resident[64];
+#else
+    unsigned char resident[64];
+#endif
+    int64_t start = from / page * page;
+    const int64_t end = from + len;
+    while (start < end) {
+        int64_t chunk = std::min<int64_t>(end - start, 64 * page);
+        // when the kernel can not tell, the copy is not counted
+        if (mincore(map + start, chunk, resident) != 0) return true;
+        for (int64_t i = 0; i < (chunk + page - 1) / page; i++)
+            if (!(resident[i] & 1)) return false;
+        start += chunk;
+    }
+    return true;
+#endif
+}
+
+int avio_source::read_pipe(uint8_t *buf, int size) {
+    int n;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (head == tail && !input_done) {
+            auto wait_start = std::chrono::steady_clock::now();
+            not_empty.wait(lock, [this] { return head != tail || input_done || !running; });
+            wait_time += std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - wait_start).count();
+        }
+        if (head == tail) return AVERROR_EOF;
+
+        // copy out in at most two pieces when the data wraps around the end of the ring
+        n = static_cast<int>(std::min<int64_t>(size, tail - head));
+        int start = static_cast<int>(head % AVIO_PIPE_RING_SIZE);
+        int first = std::min(n, AVIO_PIPE_RING_SIZE - start);
+        memcpy(buf, ring + start, first);
+        if (first < n) memcpy(buf + first, ring, n - first);
+        head += n;
+    }
+    not_full.notify_one();
+    bytes_read += n;
+    return n;
+}
+
+void avio_source::reader_loop() {
+#if defined(_WIN32)
+    int in_fd = _fileno(stdin);
+#else
+    int in_fd = STDIN_FILENO;
+#endif
+    while (true) {
+        int64_t start, space;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [this] { return !running || tail - head < AVIO_PIPE_RING_SIZE; });
+            if (!running) break;
+            start = tail % AVIO_PIPE_RING_SIZE;
+            space = std::min<int64_t>(AVIO_PIPE_RING_SIZE - (tail - head), AVIO_PIPE_RING_SIZE - start);
+        }
+
+#if !defined(_WIN32)
+        // poll so the reader notices shutdown even if upstream never closes the pipe
+        pollfd pfd{in_fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, 100);
+        // signals such as SIGWINCH interrupt the poll without anything having arrived
+        if (ready == 0 || (ready < 0 && errno == EINTR)) continue;
+#endif
+
+        // only the reader writes past tail, so the ring can be filled without the lock
+        int len = static_cast<int>(std::min<int64_t>(space, AVIO_BUFFER_SIZE * 16));
+#if defined(_WIN32)
+        int got = _read(in_fd, ring + start, len);
+#else
+        // a failed poll ends the input the same way as a failed read
+        int got = ready < 0 ? -1 : static_cast<int>(read(in_fd, ring + start, len));
+        if (got < 0 && ready > 0 && errno == EINTR) continue;
+#endif
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (got <= 0) {
+                if (got < 0) fprintf(stderr, "fail to read stdin: %s\n", strerror(errno));
+                input_done = true;
+            } else {
+                tail += got;
+            }
+        }
+        not_empty.notify_one();
+        if (got <= 0) break;
+    }
+}
@@ -0,0 +1,81 @@
+#include "frame_arena.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+static size_t align_up(size_t n, size_t alignment) {
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+frame_arena::frame_arena(size_t print_bytes, size_t cells, size_t gpu_cells, bool huge_pages) {
+    // offsets of each buffer, every one starts on its own cache line
+    size_t screen_at = 0;
+    size_t print_at = screen_at + align_up(cells * sizeof(screen_cell), FRAME_ARENA_ALIGN);
+    size_t render_at = print_at + align_up(print_bytes, FRAME_ARENA_ALIGN);
+    size_t error_at = render_at + align_up(print_bytes, FRAME_ARENA_ALIGN);
+    size_t carry_at = error_at + align_up(cells * 3 * sizeof(float), FRAME_ARENA_ALIGN);
+    size_t indices_at = carry_at + align_up(cells * 3 * sizeof(float), FRAME_ARENA_ALIGN);
+    size_t fg_at = indices_at + align_up(cells * sizeof(int), FRAME_ARENA_ALIGN);
+    size_t bg_at = fg_at + align_up(gpu_cells * sizeof(int), FRAME_ARENA_ALIGN);
+    size_t update_at = bg_at + align_up(gpu_cells * sizeof(int), FRAME_ARENA_ALIGN);
+    size_t total = update_at + align_up(gpu_cells * sizeof(bool), FRAME_ARENA_ALIGN);
+
+    // huge pages only pay off once the arena spans at least one of them
+    size_t alignment = FRAME_ARENA_ALIGN;
+    if (huge_pages && total >= FRAME_ARENA_HUGE_PAGE) alignment = FRAME_ARENA_HUGE_PAGE;
+    total = align_up(total, alignment);
+
+#if defined(_WIN32)
+    base = static_cast<char *>(_aligned_malloc(total, alignment));
+#else
+    base = static_cast<char *>(std::aligned_alloc(alignment, total));
+#endif
+    if (!base) return;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (alignment == FRAME_ARENA_HUGE_PAGE) huge = madvise(base, total, MADV_HUGEPAGE) == 0;
+#endif
+
+    // the screen state and the dithering error start out cleared, this also
+    // faults every page in now rather than during the first frame
+    memset(base, 0, total);
+    size = total;
+
+    screen = reinterpret_cast<screen_cell *>(base + screen_at);
+    print_buf = base + print_at;
+    render_buffer = base + render_at;
+    error_buffer = reinterpret_cast<float *>(base + error_at);
+    dither_carry = reinterpret_cast<float *>(base + carry_at);
+    char_indices = reinterpret_cast<int *>(base + indices_at);
+    if (gpu_cells > 0) {
+        fg_colors = reinterpret_cast<int *>(base + fg_at);
+        bg_colors = reinterpret_cast<int *>(base + bg_at);
+        needs_update = reinterpret_cast<bool *>(base + update_at);
+    }
+}
+
+frame_arena::~frame_arena() {
+#if defined(_WIN32)
+    _aligned_free(base);
+#else
+    std::free(base);
+#endif
+}
+
+bool frame_arena::is_allocated() const {
+    return base != nullptr;
+}
+
+size_t frame_arena::get_size() const {
+    return size;
+}
+
+bool frame_arena::uses_huge_pages() const {
+    return huge;
+}
@@ -0,0 +1,200 @@
+#include "frame_queue.h"
+
+#include <chrono>
+
+frame_queue::frame_queue(video &cap, int depth) : cap(cap), depth(std::max(depth, 1)) {
+    slots.resize(this->depth + 1);
+}
+
+frame_queue::~frame_queue() {
+    stop();
+    for (slot &s: slots) video::free_frame_buffer(s.buf);
+}
+
+void frame_queue::start() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (running) return;
+    running = true;
+    producer_done = false;
+    thread = std::thread(&frame_queue::decode_loop, this);
+}
+
+void frame_queue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    not_full.notify_all();
+    not_empty.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void frame_queue::abort() {
+    cap.abort();
+    stop();
+}
+
+void frame_queue::resize(int w, int h) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (w == req_width && h == req_height) return;
+
+        req_width = w;
+        req_height = h;
+        resize_pending = true;
+        generation++;
+
+        // drop everything decoded at the old size, the frame currently
+        // being decoded is dropped by the decode thread when it sees the new generation
+        // the ring is rewound to head so the lent out slot (head - 1) stays untouched
+        tail = head;
+        count = 0;
+        pending_skip = 0;
+    }
+    not_full.notify_all();
+}
+
+int frame_queue::pop(int dst_w, int dst_h, frame_buffer &dst) {
+    slot *s;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto wait_start = std::chrono::steady_clock::now();
+        not_empty.wait(lock, [this] { return count > 0 || producer_done || !running; });
+        last_stall_time = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - wait_start).count();
+        total_stall_time += last_stall_time;
+
+        if (count == 0) {
+            // decode thread has exited without leaving a frame behind
+            end_of_stream = true;
+            borrowed = -1;
+            return -1;
+        }
+        s = &slots[head];
+        // nothing is handed out, so the previous frame stays lent out as well
+        if (s->buf.width != dst_w || s->buf.height != dst_h) return 1;
+
+        // the previous frame is no longer in use, lend the new slot out in its place
+        // the decode thread will not write into it until it is returned
+        borrowed = head;
+        head = (head + 1) % static_cast<int>(slots.size());
+        count--;
+    }
+    not_full.notify_one();
+
+    dst = s->buf;
+    end_of_stream = s->end_of_stream;
+    return s->ret;
+}
+
+void frame_queue::skip(int n) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        borrowed = -1;
+        // drop frames which are already decoded first, never drop the end of stream marker
+        while (n > 0 && count > 0 && !slots[head].end_of_stream) {
+            head = (head + 1) % static_cast<int>(slots.size());
+            count--;
+            n--;
+        }
+        // the rest is skipped by the decode thread before the next frame
+        pending_skip += n;
+    }
+    not_full.notify_one();
+}
+
+bool frame_queue::is_end_of_stream() const {
+    return end_of_stream;
+}
+
+int frame_queue::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+}
+
+int frame_queue::capacity() const {
+    return depth;
+}
+
+long long frame_queue::get_last_stall_time() const {
+    return last_stall_time;
+}
+
+long long frame_queue::get_total_stall_time() const {
+    return total_stall_time;
+}
+
+long long frame_queue::get_last_decode_time() const {
+    return last_decode_time.load();
+}
+
+long long frame_queue::get_total_decode_time() const {
+    return total_decode_time.load();
+}
+
+void frame_queue::decode_loop() {
+    while (true) {
+        int w, h, skip_amt;
+        unsigned gen;
+        bool do_resize;
+        slot *s;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // wait for free space (back-pressure) or a new size
+            not_full.wait(lock, [this] {
+                return !running || resize_pending || (req_width > 0 && count < depth && tail != borrowed);
+            });
+            if (!running) break;
+
+            do_resize = resize_pending;
+            resize_pending = false;
+            w = req_width;
+            h = req_height;
+            gen = generation;
+            skip_amt = pending_skip;
+            pending_skip = 0;
+            // the tail slot is not visible to the consumer until it is pushed
+            s = &slots[tail];
+        }
+
+        // the video object is only touched from this thread once the queue is started
+        if (do_resize) cap.setResize(w, h);
+
+        if (s->buf.width != w || s->buf.height != h) {
+            if (!video::alloc_frame_buffer(s->buf, w, h, cap.get_dst_pix_fmt())) {
+                fprintf(stderr, "failed to allocate decode buffer\n");
+                std::lock_guard<std::mutex> lock(mutex);
+                producer_done = true;
+                not_empty.notify_all();
+                break;
+            }
+        }
+
+        // skipped frames are decoded only as far as the codec needs, never scaled
+        if (skip_amt > 0) cap.skip_frames(skip_amt);
+
+        auto decode_start = std::chrono::steady_clock::now();
+        int ret = cap.get_frame(s->buf);
+        s->buf.pts = cap.get_frame_pts();
+        long long decode_time = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - decode_start).count();
+        last_decode_time.store(decode_time);
+        total_decode_time.fetch_add(decode_time);
+
+        bool done = ret < 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // frame was decoded for a size which is no longer wanted
+            if (gen != generation) continue;
+
+            s->ret = ret;
+            s->end_of_stream = done;
+            tail = (tail + 1) % static_cast<int>(slots.size());
+            count++;
+            if (done) producer_done = true;
+        }
+        not_empty.notify_one();
+
+        if (done) break;
+    }
+}
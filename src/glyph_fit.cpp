@@ -0,0 +1,264 @@
+#include "glyph_fit.h"
+
+#include <algorithm>
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define GLYPH_FIT_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define GLYPH_FIT_NEON
+#include <arm_neon.h>
+#endif
+
+#include "pixelmap.h"
+
+static_assert(CHAR_Y * CHAR_X == GLYPH_FIT_PIXELS, "glyph fit kernels are written for 8x8 cells");
+
+// the glyph masks expanded to a byte per pixel, 0xff where the pixel belongs to the foreground
+struct glyph_mask_table {
+    alignas(32) uint8_t fg[DIFF_CASES][GLYPH_FIT_PIXELS];
+};
+
+static constexpr glyph_mask_table build_masks() {
+    glyph_mask_table t{};
+    for (int g = 0; g < DIFF_CASES; g++)
+        for (int p = 0; p < GLYPH_FIT_PIXELS; p++)
+            t.fg[g][p] = glyph_is_fg(g, p) ? 0xff : 0x00;
+    return t;
+}
+
+static constexpr glyph_mask_table masks = build_masks();
+
+[[maybe_unused]] static void fit_scalar(const uint8_t samples[][GLYPH_FIT_PIXELS], int channels, int glyphs, int *cases) {
+    for (int g = 0; g < glyphs; g++) {
+        int worst = 0;
+        for (int k = 0; k < channels; k++) {
+            int min_fg = 255, max_fg = 0, min_bg = 255, max_bg = 0;
+            for (int p = 0; p < GLYPH_FIT_PIXELS; p++) {
+                int v = samples[k][p];
+                if (masks.fg[g][p]) {
+                    min_fg = std::min(min_fg, v);
+                    max_fg = std::max(max_fg, v);
+                } else {
+                    min_bg = std::min(min_bg, v);
+                    max_bg = std::max(max_bg, v);
+                }
+            }
+            worst = std::max(worst, std::max(max_fg - min_fg, max_bg - min_bg));
+        }
+        cases[g] = worst;
+    }
+}
+
+#ifdef GLYPH_FIT_X86
+// the four masked reductions of a glyph, each already folded down to 16 bytes and all
+// expressed as minimums: the fg min, the inverted fg max, the bg min and the inverted bg max.
+// they are folded further together, four lanes at a time, so one reduction serves all four
+static inline int spread_sse2(__m128i fg_min, __m128i fg_max_inv, __m128i bg_min, __m128i bg_max_inv) {
+    // 16 -> 8 bytes, fg in the low half and bg in the high half of each
+    __m128i fg = _mm_min_epu8(_mm_unpacklo_epi64(fg_min, fg_max_inv), _mm_unpackhi_epi64(fg_min, fg_max_inv));
+    __m128i bg = _mm_min_epu8(_mm_unpacklo_epi64(bg_min, bg_max_inv), _mm_unpackhi_epi64(bg_min, bg_max_inv));
+    // 8 -> 4 bytes
+    fg = _mm_min_epu8(fg, _mm_shuffle_epi32(fg, _MM_SHUFFLE(2, 3, 0, 1)));
+    bg = _mm_min_epu8(bg, _mm_shuffle_epi32(bg, _MM_SHUFFLE(2, 3, 0, 1)));
+    // dwords are now fg_min, fg_max_inv, bg_min, bg_max_inv
+    __m128i all = _mm_unpacklo_epi64(_mm_unpacklo_epi32(fg, _mm_srli_si128(fg, 8)),
+                                     _mm_unpacklo_epi32(bg, _mm_srli_si128(bg, 8)));
+    // 4 -> 1 byte, the result is in the low byte of each dword
+    all = _mm_min_epu8(all, _mm_srli_epi32(all, 16));
+    all = _mm_min_epu8(all, _mm_srli_epi32(all, 8));
+
+    int min_fg = _mm_cvtsi128_si32(all) & 0xff;
+    int max_fg = 255 - (_mm_cvtsi128_si32(_mm_srli_si128(all, 4)) & 0xff);
+    int min_bg = _mm_cvtsi128_si32(_mm_srli_si128(all, 8)) & 0xff;
+    int max_bg = 255 - (_mm_cvtsi128_si32(_mm_srli_si128(all, 12)) & 0xff);
+    return std::max(max_fg - min_fg, max_bg - min_bg);
+}
+
+static void fit_sse2(const uint8_t samples[][GLYPH_FIT_PIXELS], int channels, int glyphs, int *cases) {
+    const __m128i ones = _mm_set1_epi8(-1);
+    for (int g = 0; g < glyphs; g++) cases[g] = 0;
+
+    for (int k = 0; k < channels; k++) {
+        // the cell's 64 samples and their inverse stay in registers for every glyph
+        __m128i v[4], inv[4];
+        for (int q = 0; q < 4; q++) {
+            v[q] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples[k] + q * 16));
+            inv[q] = _mm_xor_si128(v[q], ones);
+        }
+
+        for (int g = 0; g < glyphs; g++) {
+            __m128i fg_min = ones, fg_max_inv = ones, bg_min = ones, bg_max_inv = ones;
+            for (int q = 0; q < 4; q++) {
+                __m128i m = _mm_load_si128(reinterpret_cast<const __m128i *>(masks.fg[g] + q * 16));
+                // pixels outside a region are forced to 255, which never wins a minimum
+                fg_min = _mm_min_epu8(fg_min, _mm_or_si128(v[q], _mm_xor_si128(m, ones)));
+                fg_max_inv = _mm_min_epu8(fg_max_inv, _mm_or_si128(inv[q], _mm_xor_si128(m, ones)));
+                bg_min = _mm_min_epu8(bg_min, _mm_or_si128(v[q], m));
+                bg_max_inv = _mm_min_epu8(bg_max_inv, _mm_or_si128(inv[q], m));
+            }
+            cases[g] = std::max(cases[g], spread_sse2(fg_min, fg_max_inv, bg_min, bg_max_inv));
+        }
+    }
+}
+
+#if defined(__GNUC__)
+#define GLYPH_FIT_AVX2
+// 32 -> 16 bytes, the rest is shared with the sse2 path
+__attribute__((target("avx2")))
+static inline __m128i fold_avx2(__m256i x) {
+    return _mm_min_epu8(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+}
+
+__attribute__((target("avx2")))
+static void fit_avx2(const uint8_t samples[][GLYPH_FIT_PIXELS], int channels, int glyphs, int *cases) {
+    const __m256i ones = _mm256_set1_epi8(-1);
+    for (int g = 0; g < glyphs; g++) cases[g] = 0;
+
+    for (int k = 0; k < channels; k++) {
+        __m256i v[2], inv[2];
+        for (int h = 0; h < 2; h++) {
+            v[h] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(samples[k] + h * 32));
+            inv[h] = _mm256_xor_si256(v[h], ones);
+        }
+
+        for (int g = 0; g < glyphs; g++) {
+            __m256i m0 = _mm256_load_si256(reinterpret_cast<const __m256i *>(masks.fg[g]));
+            __m256i m1 = _mm256_load_si256(reinterpret_cast<const __m256i *>(masks.fg[g] + 32));
+            __m256i n0 = _mm256_xor_si256(m0, ones);
+            __m256i n1 = _mm256_xor_si256(m1, ones);
+
+            __m256i fg_min = _mm256_min_epu8(_mm256_or_si256(v[0], n0), _mm256_or_si256(v[1], n1));
+            __m256i fg_max_inv = _mm256_min_epu8(_mm256_or_si256(inv[0], n0), _mm256_or_si256(inv[1], n1));
+            __m256i bg_min = _mm256_min_epu8(_mm256_or_si256(v[0], m0), _mm256_or_si256(v[1], m1));
+            __m256i bg_max_inv = _mm256_min_epu8(_mm256_or_si256(inv[0], m0), _mm256_or_si256(inv[1], m1));
+
+            cases[g] = std::max(cases[g], spread_sse2(fold_avx2(fg_min), fold_avx2(fg_max_inv),
+                                                      fold_avx2(bg_min), fold_avx2(bg_max_inv)));
+        }
+    }
+}
+#endif
+#endif
+
+#ifdef GLYPH_FIT_NEON
+static void fit_neon(const uint8_t samples[][GLYPH_FIT_PIXELS], int channels, int glyphs, int *cases) {
+    for (int g = 0; g < glyphs; g++) cases[g] = 0;
+
+    for (int k = 0; k < channels; k++) {
+        uint8x16_t v[4];
+        for (int q = 0; q < 4; q++) v[q] = vld1q_u8(samples[k] + q * 16);
+
+        for (int g = 0; g < glyphs; g++) {
+            uint8x16_t fg_min = vdupq_n_u8(255), fg_max = vdupq_n_u8(0);
+            uint8x16_t bg_min = vdupq_n_u8(255), bg_max = vdupq_n_u8(0);
+            for (int q = 0; q < 4; q++) {
+                uint8x16_t m = vld1q_u8(masks.fg[g] + q * 16);
+                // a | ~m forces pixels outside the foreground to 255, a & m forces them to 0
+                fg_min = vminq_u8(fg_min, vornq_u8(v[q], m));
+                fg_max = vmaxq_u8(fg_max, vandq_u8(v[q], m));
+                bg_min = vminq_u8(bg_min, vorrq_u8(v[q], m));
+                bg_max = vmaxq_u8(bg_max, vbicq_u8(v[q], m));
+            }
+            int spread = std::max(static_cast<int>(vmaxvq_u8(fg_max)) - vminvq_u8(fg_min),
+                                  static_cast<int>(vmaxvq_u8(bg_max)) - vminvq_u8(bg_min));
+            cases[g] = std::max(cases[g], spread);
+        }
+    }
+}
+#endif
+
+using fit_fn = void (*)(const uint8_t [][GLYPH_FIT_PIXELS], int, int, int *);
+
+struct fit_backend {
+    fit_fn fit;
+    const char *name;
+};
+
+static fit_backend select_backend() {
+#if defined(GLYPH_FIT_AVX2)
+    // this runs as a static initializer, possibly before the one that fills in the cpu model
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {fit_avx2, "avx2"};
+#endif
+#if defined(GLYPH_FIT_X86)
+    return {fit_sse2, "sse2"};
+#elif defined(GLYPH_FIT_NEON)
+    return {fit_neon, "neon"};
+#else
+    return {fit_scalar, "scalar"};
+#endif
+}
+
+static const fit_backend backend = select_backend();
+
+void glyph_fit_minimax(const uint8_t samples[][GLYPH_FIT_PIXELS], int channels, int glyphs, int *cases) {
+    backend.fit(samples, channels, glyphs, cases);
+}
+
+// 1 / n for every possible region size, 0 for an empty region so it adds nothing
+struct region_weights {
+    float inv[GLYPH_FIT_PIXELS + 1];
+};
+
+static constexpr region_weights make_region_weights() {
+    region_weights w{};
+    for (int n = 1; n <= GLYPH_FIT_PIXELS; n++) w.inv[n] = 1.0f / static_cast<float>(n);
+    return w;
+}
+
+static constexpr region_weights weights = make_region_weights();
+
+int glyph_fit_mse(const float samples[][GLYPH_FIT_PIXELS], int channels, int glyphs) {
+    // filling a region with its mean leaves an error of sum(x^2) - S^2 / n, where S is the
+    // region's sum. sum(x^2) is the same for every glyph, so the best glyph is the one
+    // with the largest S_fg^2 / n_fg + S_bg^2 / n_bg over all channels, and S_bg is the
+    // cell total minus S_fg. only the masked sum S_fg is needed per glyph
+    //
+    // it comes from nibble tables: for every group of 4 consecutive pixels the sums of all
+    // 16 subsets of them, indexed by the 4 mask bits covering the group. a glyph's S_fg is
+    // then 16 lookups per channel instead of a loop over its 64 pixels
+    constexpr int groups = GLYPH_FIT_PIXELS / 4;
+    float subset_sums[3][groups][16];
+    float totals[3];
+    channels = std::min(channels, 3);
+
+    for (int k = 0; k < channels; k++) {
+        totals[k] = 0;
+        for (int q = 0; q < groups; q++) {
+            const float *px = samples[k] + q * 4;
+            float *sums = subset_sums[k][q];
+            sums[0] = 0;
+            // every subset is a smaller subset plus its lowest pixel
+            for (int n = 1; n < 16; n++) sums[n] = sums[n & (n - 1)] + px[std::countr_zero(static_cast<unsigned>(n))];
+            totals[k] += sums[15];
+        }
+    }
+
+    int best = 0;
+    float best_fit = -1;
+    for (int g = 0; g < glyphs; g++) {
+        const uint64_t mask = glyph_masks[g];
+        const float inv_fg = weights.inv[glyph_fg_count[g]];
+        const float inv_bg = weights.inv[GLYPH_FIT_PIXELS - glyph_fg_count[g]];
+
+        float fit = 0;
+        for (int k = 0; k < channels; k++) {
+            float s_fg = 0;
+            for (int q = 0; q < groups; q++) s_fg += subset_sums[k][q][(mask >> (q * 4)) & 0xf];
+            float s_bg = totals[k] - s_fg;
+            fit += s_fg * s_fg * inv_fg + s_bg * s_bg * inv_bg;
+        }
+
+        if (fit > best_fit) {
+            best_fit = fit;
+            best = g;
+        }
+    }
+    return best;
+}
+
+const char *glyph_fit_backend() {
+    return backend.name;
+}
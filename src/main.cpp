@@ -9,8 +9,14 @@
 #include <condition_variable>
 #include <atomic>
 #include <cstdlib>
+#include <future>
 
 #include "video.h"
+#include "frame_queue.h"
+#include "frame_arena.h"
+#include "worker_pool.h"
+#include "glyph_fit.h"
+#include "ansi_emitter.h"
 
 #ifdef HAVE_OPENCL
 #include "opencl_proc.h"
@@ -24,23 +30,49 @@
 #define DEFAULT_DIFFTHRESHOLD 10
 #define CHANGE_THRESHOLD 10
 
+// a cpu cell whose samples lie within this range of each other in every channel is flat,
+// it skips the glyph fit and is printed as a blank in its average colour
+#define FLAT_CELL_RANGE 6
+
 // dithering decay value
 #define CPU_DITHERING_DECAY 0.45f
 
 // fps calculation averaging window
 #define FPS_AVGING_AMT 24
 
+// number of frames decoded ahead of the renderer
+#define DEFAULT_DECODE_AHEAD 4
+
+// longest a frame is waited for before its timestamp is treated as a discontinuity, in seconds
+#define MAX_FRAME_WAIT 1.0
+
+// a new terminal size is only applied once it has not changed for this long
+#define RESIZE_DEBOUNCE_MS 150
+// windows has no SIGWINCH, so the console size is polled at this interval instead
+#define RESIZE_POLL_MS 250
+
 // cpu floyd steinberg or atkinson dithering
 // (atkinson will be slower)
 #define ATKINSON_DITHERING
 
-// use reduced character set for cpu to reduce
-// computations and speedup rendering time
+// use reduced character set for the cpu minimax fit to reduce
+// computations and speedup rendering time, --cpu-mse fits the full set
 #define CPU_REDUCED_CHARSET_AMT 25
 
 #define HEADER_SPACING_LINES 3
 #define PRINT_CHARS_MARGIN 6
 
+// bytes of print buffer per cell, the cells of the video take at most ANSI_MAX_CELL_BYTES each
+#define PRINT_BYTES_PER_CELL 60
+
+static_assert(ANSI_MAX_CELL_BYTES <= PRINT_BYTES_PER_CELL, "a cell has to fit in its share of the print buffer");
+
+// the cpu renderer splits the cell rows into bands, a few per thread so a band of mostly
+// unchanged rows does not leave its thread idle, but never thinner than this many rows
+#define CPU_BANDS_PER_THREAD 2
+#define CPU_BAND_MIN_ROWS 4
+#define RENDER_THREADS_AUTO 0
+
 #include "pixelmap.h"
 
 #if defined(_WIN32)
@@ -89,12 +121,11 @@ void get_terminal_size(int &width, int &height) {
 #endif
 }
 
-const char *shapechar;
 long long count = 0, curr_frame = 0;;
 double fps;
 int period = 0;
 
-long long printing_time, rendering_time, decode_time, elapsed;
+long long printing_time, rendering_time, decode_time, decode_stall_time, elapsed;
 double avg_fps = 0;
 long long total_time = 0, avg_frame_times_sum = 0;
 std::queue<long long> frame_times;
@@ -104,12 +135,25 @@ double skip;
 
 std::chrono::time_point<std::chrono::steady_clock> start, stop, render_start, render_end;
 std::chrono::time_point<std::chrono::steady_clock> video_start, video_stop;
-std::chrono::time_point<std::chrono::steady_clock> decode_start, decode_end;
+// time from launch until the first frame is handed to the write thread, in microseconds
+std::chrono::time_point<std::chrono::steady_clock> program_start;
+long long time_to_first_frame = -1;
 long long total_printing_time = 0;
 long long total_render_time = 0;
 long long total_decode_time = 0;
+long long total_decode_stall_time = 0;
+long long total_io_wait_time = 0;
+// distance between the timestamp of each presented frame and the master clock, in milliseconds
+double av_drift_sum = 0, av_drift_max = 0;
+long long av_drift_frames = 0;
 int cursor_moves = 0;
 
+// decode-ahead thread feeding the render loop
+frame_queue *decode_queue = nullptr;
+
+// set by SIGWINCH, the terminal size is only queried after it changes
+std::atomic<bool> terminal_resized(true);
+
 // thread management for write operations
 std::mutex render_buffer_mutex;
 std::condition_variable buffer_ready_cv;
@@ -117,6 +161,10 @@ std::condition_variable buffer_ready_cv;
 char *render_buffer = nullptr;
 int render_buffer_size = 0;
 int render_buffer_written = 0;
+// set under the lock when the screen has to be cleared to black, the write thread clears it right
+// before the next frame, so the clear never lands in the middle of a frame it is writing
+bool clear_screen_pending = false;
+const char screen_clear[] = "\x1B[2J\x1B[H\x1B[48;2;0;0;0m";
 // threading signals for next frame and shutdown
 std::atomic<bool> frame_ready(false);
 std::atomic<bool> write_thread_running(true);
@@ -126,19 +174,63 @@ std::atomic<int> last_printing_time(0);
 std::atomic<long long> total_chars_printed(0ll);
 
 // tracking usage of different unicode characters
-long long char_usage[DIFF_CASES] = {0};
+long long char_usage[ANSI_GLYPHS] = {0};
 long long rendered_cursor_moves = 0;
 long long rendered_cursor_chars = 0;
+// colour bytes left out because the colours the terminal had were known
+long long rendered_sgr_saved = 0;
 
 // print character usage rates
 bool print_hit_rate = false;
 
+// what one band of the cpu renderer produced, joined into the print buffer after all bands finish
+struct band_output {
+    int row_begin = 0, row_end = 0;
+    // where the band's slice starts in the print buffer, and how much of it was used
+    int offset = 0;
+    int written = 0;
+    // the cursor move the band opened with and the cell it moved to
+    int first_move_len = 0;
+    int first_r = -1, first_c = -1;
+    // where the band left the cursor
+    int last_r = -1, last_c = -1;
+    // the colours a band below the first one opened with, where they are in its slice, and
+    // the colours it left set
+    int first_sgr_at = 0;
+    int first_sgr_len = 0;
+    int first_bg[3] = {0}, first_fg[3] = {0};
+    int last_bg[3] = {0}, last_fg[3] = {0};
+    int sgr_saved = 0;
+    int cursor_moves = 0;
+    long long rendered_moves = 0;
+    long long rendered_chars = 0;
+    long long char_usage[ANSI_GLYPHS] = {0};
+};
+
+const char *decode_quality_desc[DECODE_QUALITY_MAX + 1] = {
+    "full",
+    "skip loop filter on non-ref frames",
+    "skip loop filter, skip idct on non-ref frames",
+    "skip loop filter, skip idct on non-ref frames, lowres if supported",
+};
+
 int diff_threshold = DEFAULT_DIFFTHRESHOLD;
 
-// char width scaling (assuming terminal chars are 2x1 hxw)
-int sx = CHAR_X, sy = CHAR_X * 2;
+// terminal cell size used to fit the video, in square pixels (assuming terminal chars are 2x1 hxw)
+#define CELL_PX_W CHAR_X
+#define CELL_PX_H (CHAR_X * 2)
+
+// size of one terminal cell in the decoded frame and the stride used to sample it
+// by default the frame is scaled to the full cell size and every other row is sampled,
+// with grid scaling the decoder scales straight to the CHAR_X x CHAR_Y sampling grid
+int sx = CELL_PX_W, sy = CELL_PX_H;
 int skipy = sy / CHAR_Y, skipx = sx / CHAR_X;
 
+// SIGWINCH handler, the render loop picks up the new size
+void on_terminal_resize([[maybe_unused]] int sig_num) {
+    terminal_resized = true;
+}
+
 // function to intercept SIGINT such that we print the ANSI code to restore the cursor visibility
 // and also print some statistics about the video played
 void terminateProgram([[maybe_unused]] int sig_num) {
@@ -148,6 +240,11 @@ void terminateProgram([[maybe_unused]] int sig_num) {
     if (write_thread.joinable()) {
         write_thread.join();
     }
+    if (decode_queue) {
+        decode_queue->abort();
+        total_decode_time = decode_queue->get_total_decode_time();
+        total_decode_stall_time = decode_queue->get_total_stall_time();
+    }
 
     // sum total character renders
     long long total_chars = 0;
@@ -162,7 +259,7 @@ void terminateProgram([[maybe_unused]] int sig_num) {
     get_terminal_size(term_w, term_h);
 
     // dimensions for both boxes
-    int stats_lines = 14;
+    int stats_lines = 19;
     int stats_width = 45;
     int usage_width = 35;
     int spacing = 3;
@@ -173,7 +270,7 @@ void terminateProgram([[maybe_unused]] int sig_num) {
     int usage_lines = 0;
 
     if (print_hit_rate) {
-        for (int i = 0; i < DIFF_CASES; i++) {
+        for (int i = 0; i < ANSI_GLYPHS; i++) {
             if (char_usage[i] > 0) used_chars++;
         }
         usage_lines = used_chars + 3;
@@ -231,30 +328,42 @@ void terminateProgram([[maybe_unused]] int sig_num) {
     printf("\x1B[%d;%dH\x1B[48;2;0;0;0;38;2;255;255;255m PLAYBACK STATISTICS ", stats_start_row + 1, stats_start_col);
     printf("\x1B[%d;%dH frames rendered:  %lld", stats_start_row + 2, stats_start_col, curr_frame);
     printf("\x1B[%d;%dH frames dropped:   %lld", stats_start_row + 3, stats_start_col, dropped);
-    printf("\x1B[%d;%dH total time:       %.2fs", stats_start_row + 5, stats_start_col, (double) total_video_time / 1000000.0);
-    printf("\x1B[%d;%dH decode time:      %.2fs  (%.1f%%)", stats_start_row + 6, stats_start_col,
+    printf("\x1B[%d;%dH first frame:      %.1fms", stats_start_row + 4, stats_start_col,
+        (double) time_to_first_frame / 1000.0);
+    printf("\x1B[%d;%dH total time:       %.2fs", stats_start_row + 6, stats_start_col, (double) total_video_time / 1000000.0);
+    printf("\x1B[%d;%dH decode time:      %.2fs  (%.1f%%)", stats_start_row + 7, stats_start_col,
         (double) total_decode_time / 1000000.0,
         (double) total_decode_time * 100.0 / (double) total_video_time);
-    printf("\x1B[%d;%dH render time:      %.2fs  (%.1f%%)", stats_start_row + 7, stats_start_col,
+    printf("\x1B[%d;%dH render time:      %.2fs  (%.1f%%)", stats_start_row + 8, stats_start_col,
         (double) total_render_time / 1000000.0,
         (double) total_render_time * 100.0 / (double) total_video_time);
-    printf("\x1B[%d;%dH printing time:    %.2fs  (%.1f%%)", stats_start_row + 8, stats_start_col,
+    printf("\x1B[%d;%dH printing time:    %.2fs  (%.1f%%)", stats_start_row + 9, stats_start_col,
         (double) total_printing_time / 1000000.0,
         (double) total_printing_time * 100.0 / (double) total_video_time);
-    printf("\x1B[%d;%dH chars rendered:   %lldk", stats_start_row + 10, stats_start_col, total_chars / 1000ll);
-    printf("\x1B[%d;%dH chars printed:    %lldk", stats_start_row + 11, stats_start_col, total_chars_printed.load() / 1000ll);
-    printf("\x1B[%d;%dH cursor moves:     %lldk  (%lldk chars)", stats_start_row + 12, stats_start_col,
+    printf("\x1B[%d;%dH decode stall:     %.2fs  (%.1f%%)", stats_start_row + 10, stats_start_col,
+        (double) total_decode_stall_time / 1000000.0,
+        (double) total_decode_stall_time * 100.0 / (double) total_video_time);
+    printf("\x1B[%d;%dH io wait:          %.2fs  (%.1f%%)", stats_start_row + 11, stats_start_col,
+        (double) total_io_wait_time / 1000000.0,
+        (double) total_io_wait_time * 100.0 / (double) total_video_time);
+    printf("\x1B[%d;%dH a/v drift:        %.1fms avg  %.1fms max", stats_start_row + 12, stats_start_col,
+        av_drift_frames > 0 ? av_drift_sum / (double) av_drift_frames : 0.0, av_drift_max);
+    printf("\x1B[%d;%dH chars rendered:   %lldk", stats_start_row + 14, stats_start_col, total_chars / 1000ll);
+    printf("\x1B[%d;%dH chars printed:    %lldk", stats_start_row + 15, stats_start_col, total_chars_printed.load() / 1000ll);
+    printf("\x1B[%d;%dH cursor moves:     %lldk  (%lldk chars)", stats_start_row + 16, stats_start_col,
         rendered_cursor_moves / 1000ll, rendered_cursor_chars / 1000ll);
+    printf("\x1B[%d;%dH colours saved:    %lldk  (%.0f per frame)", stats_start_row + 17, stats_start_col,
+        rendered_sgr_saved / 1000ll, curr_frame > 0 ? (double) rendered_sgr_saved / (double) curr_frame : 0.0);
 
     // move cursor to bottom of screen and show cursor
     printf("\x1B[%d;1H\u001b[?25h", term_h);
 
     if (print_hit_rate) {
-        int sorted_indices[DIFF_CASES];
-        for (int i = 0; i < DIFF_CASES; i++) sorted_indices[i] = i;
+        int sorted_indices[ANSI_GLYPHS];
+        for (int i = 0; i < ANSI_GLYPHS; i++) sorted_indices[i] = i;
 
         // descending sort by usage count
-        std::sort(sorted_indices, sorted_indices + DIFF_CASES,
+        std::sort(sorted_indices, sorted_indices + ANSI_GLYPHS,
                   [](const int a, const int b) { return char_usage[a] > char_usage[b]; });
 
         // recalculate position if needed
@@ -280,13 +389,13 @@ void terminateProgram([[maybe_unused]] int sig_num) {
 
         int line = 2;
         int displayed = 0;
-        for (int i = 0; i < DIFF_CASES && displayed < entries_to_show; i++) {
+        for (int i = 0; i < ANSI_GLYPHS && displayed < entries_to_show; i++) {
             int idx = sorted_indices[i];
             if (char_usage[idx] > 0) {
                 double percentage = (double) char_usage[idx] * 100.0 / (double) total_chars;
                 printf("\x1B[%d;%dH %2d. %11lld  (%6.2f%%)  %s",
                        usage_start_row + line, usage_start_col,
-                       i + 1, char_usage[idx], percentage, characters[idx]);
+                       i + 1, char_usage[idx], percentage, idx == ANSI_BLANK ? "(blank)" : characters[idx]);
                 line++;
                 displayed++;
             }
@@ -397,6 +506,71 @@ inline int perceptual_diff(const int r1, const int g1, const int b1, const int r
 }
 #endif
 
+// planar yuv frames are compared and fitted in yuv, only the final colours
+// of updated cells are converted, kr and kb are set from the matrix of the video
+static float yuv_kr = 0.2126f, yuv_kb = 0.0722f;
+
+void init_yuv_matrix(const AVColorSpace colorspace) {
+    switch (colorspace) {
+        case AVCOL_SPC_BT709:
+            yuv_kr = 0.2126f;
+            yuv_kb = 0.0722f;
+            break;
+        case AVCOL_SPC_BT2020_NCL:
+        case AVCOL_SPC_BT2020_CL:
+            yuv_kr = 0.2627f;
+            yuv_kb = 0.0593f;
+            break;
+        default:
+            yuv_kr = 0.299f;
+            yuv_kb = 0.114f;
+            break;
+    }
+}
+
+// limited range yuv to bgr, matching the channel order of the bgr24 path
+inline void yuv_to_bgr(const int yuv[3], int bgr[3]) {
+    float y = static_cast<float>(yuv[0] - 16) * (255.0f / 219.0f);
+    float cb = static_cast<float>(yuv[1] - 128) * (255.0f / 224.0f);
+    float cr = static_cast<float>(yuv[2] - 128) * (255.0f / 224.0f);
+    float r = y + 2.0f * (1.0f - yuv_kr) * cr;
+    float b = y + 2.0f * (1.0f - yuv_kb) * cb;
+    float g = (y - yuv_kr * r - yuv_kb * b) / (1.0f - yuv_kr - yuv_kb);
+    bgr[0] = std::clamp(static_cast<int>(std::lround(b)), 0, 255);
+    bgr[1] = std::clamp(static_cast<int>(std::lround(g)), 0, 255);
+    bgr[2] = std::clamp(static_cast<int>(std::lround(r)), 0, 255);
+}
+
+inline void bgr_to_yuv(const int bgr[3], int yuv[3]) {
+    float y = yuv_kr * bgr[2] + (1.0f - yuv_kr - yuv_kb) * bgr[1] + yuv_kb * bgr[0];
+    float cb = (bgr[0] - y) / (2.0f * (1.0f - yuv_kb));
+    float cr = (bgr[2] - y) / (2.0f * (1.0f - yuv_kr));
+    yuv[0] = std::clamp(static_cast<int>(std::lround(y * (219.0f / 255.0f) + 16.0f)), 0, 255);
+    yuv[1] = std::clamp(static_cast<int>(std::lround(cb * (224.0f / 255.0f) + 128.0f)), 0, 255);
+    yuv[2] = std::clamp(static_cast<int>(std::lround(cr * (224.0f / 255.0f) + 128.0f)), 0, 255);
+}
+
+// weighted so a grey step gives about the same diff as perceptual_diff on the same step in rgb
+inline int yuv_diff(const int y1, const int u1, const int v1, const int y2, const int u2, const int v2) {
+    int dy = y1 - y2;
+    int du = u1 - u2;
+    int dv = v1 - v2;
+    return sqrt_lut[12 * dy * dy + du * du + dv * dv];
+}
+
+// whether every channel of a cell's samples stays within FLAT_CELL_RANGE
+inline bool cell_is_flat(const uint8_t samples[3][GLYPH_FIT_PIXELS]) {
+    for (int k = 0; k < 3; k++) {
+        uint8_t lo = 255, hi = 0;
+        for (int p = 0; p < GLYPH_FIT_PIXELS; p++) {
+            lo = std::min(lo, samples[k][p]);
+            hi = std::max(hi, samples[k][p]);
+        }
+        if (hi - lo > FLAT_CELL_RANGE) return false;
+    }
+    return true;
+}
+
 void write_thread_func() {
     char *write_buffer_local = nullptr;
     int write_buffer_size_local = 0;
@@ -426,6 +600,8 @@ void write_thread_func() {
             // copy render buffer to local print buffer
             memcpy(write_buffer_local, render_buffer, render_buffer_written);
             int bytes_to_write = render_buffer_written;
+            bool clear = clear_screen_pending;
+            clear_screen_pending = false;
             frame_ready = false;
 
             // release lock right after copying
@@ -433,6 +609,7 @@ void write_thread_func() {
 
             // profile write time
             std::chrono::time_point<std::chrono::steady_clock> printtime = std::chrono::steady_clock::now();
+            if (clear) write(STDOUT_FILENO, screen_clear, sizeof(screen_clear) - 1);
             // write entire buffer in one call
             write(STDOUT_FILENO, write_buffer_local, bytes_to_write);
             std::chrono::time_point<std::chrono::steady_clock> print_end = std::chrono::steady_clock::now();
@@ -454,12 +631,16 @@ void write_thread_func() {
 }
 
 int main(int argc, char *argv[]) {
+    program_start = std::chrono::steady_clock::now();
     init_luts();
     // initialise time reference so its valid in the SIGINT handler
     video_start = std::chrono::steady_clock::now();
 
     // bind the function to the SIGINT signal
     signal(SIGINT, terminateProgram);
+#if !defined(_WIN32)
+    signal(SIGWINCH, on_terminal_resize);
+#endif
 
 #ifdef _WIN32
     // Set console to UTF-8
@@ -481,6 +662,20 @@ int main(int argc, char *argv[]) {
     bool dither_enable = false;
     bool use_stdin = false;
     bool file_arg_provided = false;
+    bool grid_scale = false;
+    bool planar_yuv = false;
+    bool fast_start = false;
+    bool huge_pages = false;
+    bool cpu_mse = false;
+    // runs of repeated cells, REP is off by default as not every terminal has it
+    bool use_rep = false;
+    bool use_ech = true;
+    int decode_quality = DECODE_QUALITY_AUTO;
+    int decode_threads = DECODE_THREADS_AUTO;
+    int decode_thread_type = DECODE_THREAD_TYPE_AUTO;
+    int scale_threads = SCALE_THREADS_AUTO;
+    int decode_ahead = DEFAULT_DECODE_AHEAD;
+    int render_threads = RENDER_THREADS_AUTO;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--help") == 0) {
@@ -492,6 +687,20 @@ int main(int argc, char *argv[]) {
             printf("  --no-audio       Disable audio playback\n");
             printf("  --dither         Enable dithering\n");
             printf("  --print-usage    Print character usage rates\n");
+            printf("  --decode-ahead N Number of frames to decode ahead (default %d)\n", DEFAULT_DECODE_AHEAD);
+            printf("  --grid-scale     Scale straight to the sampling grid with an area filter\n");
+            printf("  --yuv            Render from planar yuv instead of bgr (cpu only)\n");
+            printf("  --fast-start     Probe less, init opencl in parallel and skip the info delay\n");
+            printf("  --huge-pages     Back the frame buffers with transparent huge pages\n");
+            printf("  --cpu-mse        Fit all glyphs by squared error on the cpu, as opencl does\n");
+            printf("  --rep            Print runs of repeated cells with REP, if the terminal supports it\n");
+            printf("  --no-ech         Print flat runs of cells in full instead of erasing them with ECH\n");
+            printf("  --decode-quality auto|0-%d  Decoder shortcuts for downscaled playback (default auto)\n",
+                   DECODE_QUALITY_MAX);
+            printf("  --decode-threads N|auto  Number of decoder threads (default auto)\n");
+            printf("  --decode-thread-type frame|slice|auto  Decoder threading mode (default auto)\n");
+            printf("  --scale-threads N|auto  Number of slices the scaler is split into (default auto)\n");
+            printf("  --render-threads N|auto  Number of threads the cpu renderer uses (default auto)\n");
             printf("  --help           Show this help message\n");
             return 0;
         }
@@ -503,6 +712,43 @@ int main(int argc, char *argv[]) {
             dither_enable = true;
         } else if (strcmp(argv[i], "--print-usage") == 0) {
             print_hit_rate = true;
+        } else if (strcmp(argv[i], "--grid-scale") == 0) {
+            grid_scale = true;
+        } else if (strcmp(argv[i], "--yuv") == 0) {
+            planar_yuv = true;
+        } else if (strcmp(argv[i], "--fast-start") == 0) {
+            fast_start = true;
+        } else if (strcmp(argv[i], "--huge-pages") == 0) {
+            huge_pages = true;
+        } else if (strcmp(argv[i], "--cpu-mse") == 0) {
+            cpu_mse = true;
+        } else if (strcmp(argv[i], "--rep") == 0) {
+            use_rep = true;
+        } else if (strcmp(argv[i], "--no-ech") == 0) {
+            use_ech = false;
+        } else if (strcmp(argv[i], "--decode-quality") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "auto") == 0) decode_quality = DECODE_QUALITY_AUTO;
+            else decode_quality = std::clamp(std::stoi(argv[i], nullptr, 10), 0, DECODE_QUALITY_MAX);
+        } else if (strcmp(argv[i], "--decode-threads") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "auto") == 0) decode_threads = DECODE_THREADS_AUTO;
+            else decode_threads = std::max(1, std::stoi(argv[i], nullptr, 10));
+        } else if (strcmp(argv[i], "--decode-thread-type") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "frame") == 0) decode_thread_type = FF_THREAD_FRAME;
+            else if (strcmp(argv[i], "slice") == 0) decode_thread_type = FF_THREAD_SLICE;
+            else decode_thread_type = DECODE_THREAD_TYPE_AUTO;
+        } else if (strcmp(argv[i], "--scale-threads") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "auto") == 0) scale_threads = SCALE_THREADS_AUTO;
+            else scale_threads = std::max(1, std::stoi(argv[i], nullptr, 10));
+        } else if (strcmp(argv[i], "--render-threads") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "auto") == 0) render_threads = RENDER_THREADS_AUTO;
+            else render_threads = std::max(1, std::stoi(argv[i], nullptr, 10));
+        } else if (strcmp(argv[i], "--decode-ahead") == 0 && i + 1 < argc) {
+            decode_ahead = std::max(1, std::stoi(argv[++i], nullptr, 10));
         } else if (strcmp(argv[i], "-") == 0 && video_file == nullptr) {
             use_stdin = true;
             video_file = "pipe:0";  // ffmpeg name for stdin
@@ -557,8 +803,44 @@ int main(int argc, char *argv[]) {
         bool use_opencl = false;
 #ifdef HAVE_OPENCL
         OpenCLProc ocl;
-        if (enable_opencl) {
-            use_opencl = ocl.initialize();
+        // building the kernel takes a while, with fast start it overlaps opening and probing the input
+        std::future<bool> ocl_ready;
+        if (enable_opencl && !planar_yuv) {
+            ocl_ready = std::async(fast_start ? std::launch::async : std::launch::deferred,
+                                   &OpenCLProc::initialize, &ocl);
+        }
+#endif
+
+        // the terminal size is used as a hint for how much detail the decoder has to produce
+        int hint_w, hint_h;
+        get_terminal_size(hint_w, hint_h);
+
+        video_options video_opts;
+        video_opts.enable_audio = enable_audio;
+        video_opts.decode_quality = decode_quality;
+        video_opts.target_width = hint_w * CELL_PX_W;
+        video_opts.target_height = (hint_h - 1) * CELL_PX_H;
+        video_opts.decode_threads = decode_threads;
+        video_opts.decode_thread_type = decode_thread_type;
+        video_opts.scale_threads = scale_threads;
+        video_opts.planar_yuv = planar_yuv;
+        video_opts.fast_start = fast_start;
+
+        // open the video file and create the decode object
+        video cap(video_file, -1, -1, video_opts);
+
+        // check if successfully opened
+        if (!cap.isOpened()) {
+            printf("\x1B[0mError opening video stream or file\n");
+            fflush(stdout);
+            return -1;
+        }
+
+#ifdef HAVE_OPENCL
+        if (enable_opencl && planar_yuv) {
+            printf("opencl acceleration: disabled (planar yuv is rendered on the cpu)\n");
+        } else if (enable_opencl) {
+            use_opencl = ocl_ready.get();
             if (use_opencl) {
                 printf("opencl acceleration: enabled (using device: %s)\n", ocl.getDeviceName().c_str());
             } else {
@@ -571,38 +853,74 @@ int main(int argc, char *argv[]) {
         printf("opencl acceleration: disabled (not built with opencl support)\n");
 #endif
 
-        // open the video file and create the decode object
-        video cap(video_file, -1, -1, enable_audio);
-
-        // check if successfully opened
-        if (!cap.isOpened()) {
-            printf("\x1B[0mError opening video stream or file\n");
-            fflush(stdout);
-            return -1;
-        }
+        // the cpu renderer runs on the pool's threads and this one, the opencl path does not use it
+        if (render_threads == RENDER_THREADS_AUTO)
+            render_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        worker_pool render_pool(use_opencl ? 0 : render_threads - 1);
+        std::vector<band_output> band_outputs;
 
         // get video FPS and compute period of each frame
         fps = cap.get_fps();
         period = static_cast<int>(1000000.0 / fps);
 
+        // scale straight to the sampling grid, averaging each sample's area instead of point sampling
+        if (grid_scale) {
+            sx = CHAR_X;
+            sy = CHAR_Y;
+            skipx = 1;
+            skipy = 1;
+            cap.set_scale_flags(SWS_AREA);
+        }
+
+        // source dimensions, the output size of cap is owned by the decode thread from here on
+        const int src_w = cap.get_width();
+        const int src_h = cap.get_height();
+
+        // with planar frames the chroma planes are sampled at the luma position shifted by chroma_shift
+        const AVPixelFormat frame_fmt = cap.get_dst_pix_fmt();
+        const bool planar = frame_fmt != AV_PIX_FMT_BGR24;
+        const int chroma_shift = frame_fmt == AV_PIX_FMT_YUV420P ? 1 : 0;
+        if (planar) init_yuv_matrix(cap.get_colorspace());
+
+        // decode frames ahead of the renderer on a separate thread
+        frame_queue frames(cap, decode_ahead);
+        decode_queue = &frames;
+        frames.start();
+
         // initialise the time reference for the frame time counter
         start = std::chrono::steady_clock::now();
 
         // variables used for scaling to terminal size
         int w = -1, h = -1;
-        int curr_w, curr_h, orig_w = -1, orig_h = -1;
+        int curr_w = -1, curr_h = -1, orig_w = -1, orig_h = -1;
+        // size reported after the last resize signal, applied once it has settled
+        int pending_w = -1, pending_h = -1;
+        bool resize_settling = false;
+        auto resize_deadline = std::chrono::steady_clock::now();
+#if defined(_WIN32)
+        auto last_size_poll = std::chrono::steady_clock::now();
+#endif
         int im_w, im_h;
         double scale_factor = 0.0;
         int small_dims[2];
+        int frame_dims[2];
 
         // variables used for handling the image data
+        // the current frame is lent out by the decode queue
+        frame_buffer frame_buf;
         char *frame = nullptr;
-        char *old = nullptr;
+        int frame_stride = 0;
+        // glyph and colours of every cell on screen, compared against the next frame
+        screen_cell *screen = nullptr;
         bool alloc = false;
+        // owner of screen and every other per-geometry buffer below
+        frame_arena *arena = nullptr;
 
         // error buffer to store color errors so we can keep track and
         // diffuse color error to neighboring pixels
         float *error_buffer = nullptr; // stores RGB error for next character
+        // error diffused across a band seam of the cpu renderer, added to error_buffer after the frame
+        float *dither_carry = nullptr;
 
         // printing buffer
         char *print_buf = nullptr;
@@ -618,26 +936,40 @@ int main(int argc, char *argv[]) {
         bool *needs_update = nullptr;
 
         // variables used for pixel update
-        int diff = 0;
-        int pixel[CHAR_Y][CHAR_X][3];
         bool refresh = false;
         bool begin = true;
 
         // variables used to see if ansi colour command needs to be reprinted
         bool bgsame = false, pixelsame = false;
 
-        int prevpixelbg[3] = {1000, 1000, 1000};
         int pixelbg[3], pixelchar[3];
-        int prevpixel[3] = {1000, 1000, 1000};
-
-        // variables used to keep track of cursor location
-        int r, c;
+        // the colours the terminal has once everything printed so far is written, the status
+        // line leaves its own colours set at the end of every frame
+        int sgr_bg[3] = {ANSI_SGR_UNKNOWN, ANSI_SGR_UNKNOWN, ANSI_SGR_UNKNOWN};
+        int sgr_fg[3] = {ANSI_SGR_UNKNOWN, ANSI_SGR_UNKNOWN, ANSI_SGR_UNKNOWN};
+        const int status_bg[3] = {0, 0, 0};
+        const int status_fg[3] = {255, 255, 255};
+        // colour bytes the known colours saved this frame
+        int sgr_saved = 0;
 
         // variables used to select the pixel type to print
-        int mindiff, diffbg, diffpixel;
-        int min_fg, min_bg, max_fg, max_bg;
-        int cases[DIFF_CASES];
-        int case_min = 0;
+        int diffbg, diffpixel;
+
+        // media time frames are presented against. audio is the master clock while it plays,
+        // and the wall clock carries on from the last audio time when there is no audio or it runs dry
+        bool clock_started = false;
+        double clock_media = 0;
+        auto clock_wall = std::chrono::steady_clock::now();
+        auto master_clock = [&]() {
+            auto now = std::chrono::steady_clock::now();
+            double audio_time;
+            if (cap.get_audio_clock(audio_time)) {
+                clock_media = audio_time;
+                clock_wall = now;
+                return audio_time;
+            }
+            return clock_media + std::chrono::duration<double>(now - clock_wall).count();
+        };
 
         write_thread = std::thread(write_thread_func);
 
@@ -645,7 +977,48 @@ int main(int argc, char *argv[]) {
             count++; // count the actual number of frames printed
             curr_frame++; // count the current frame we are on
 
-            get_terminal_size(curr_w, curr_h);
+#if defined(_WIN32)
+            // no SIGWINCH on windows, poll the console size at a fixed interval instead
+            if (std::chrono::steady_clock::now() - last_size_poll > std::chrono::milliseconds(RESIZE_POLL_MS)) {
+                last_size_poll = std::chrono::steady_clock::now();
+                terminal_resized = true;
+            }
+#endif
+
+            // a resize restarts the debounce, the layout only changes once the size has settled
+            // so a drag-resize reallocates once instead of on every intermediate size
+            if (terminal_resized.exchange(false)) {
+                get_terminal_size(pending_w, pending_h);
+                // once settling, a drag back to the old size still ends with a redraw
+                resize_settling = resize_settling || pending_w != orig_w || pending_h != orig_h;
+                resize_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(RESIZE_DEBOUNCE_MS);
+                // nothing to keep showing before the first layout
+                if (orig_w < 0) resize_deadline = std::chrono::steady_clock::now();
+            }
+            // until then frames are still drawn at the current layout, clipped to the size the
+            // terminal has now, and only the reallocation waits
+            bool clip_frame = false;
+            if (resize_settling) {
+                if (std::chrono::steady_clock::now() >= resize_deadline) {
+                    resize_settling = false;
+                    // the clipped frames and the terminal's own reflow leave the screen stale
+                    refresh = true;
+                    if (pending_w == orig_w && pending_h == orig_h) {
+                        // a clipped frame still waiting to be written is dropped
+                        std::lock_guard<std::mutex> lock(render_buffer_mutex);
+                        clear_screen_pending = true;
+                        frame_ready = false;
+                        for (int k = 0; k < 3; k++) sgr_bg[k] = 0;
+                    }
+                    curr_w = pending_w;
+                    curr_h = pending_h;
+                } else {
+                    clip_frame = true;
+                }
+            }
+            // the terminal size the output has to fit
+            const int view_w = clip_frame ? pending_w : curr_w;
+            const int view_h = clip_frame ? pending_h : curr_h;
 
             // if the terminal size has changed, recompute scaling
             if (curr_w != orig_w || curr_h != orig_h) {
@@ -655,18 +1028,22 @@ int main(int argc, char *argv[]) {
                 h = curr_h;
                 h -= 1; // leave one line for the fps and other info to be printed
                 msg_y = h;
-                h *= sy;
-                w *= sx;
-                im_w = cap.get_width();
-                im_h = cap.get_height();
+                h *= CELL_PX_H;
+                w *= CELL_PX_W;
+                im_w = src_w;
+                im_h = src_h;
 
                 // get the scaling to fit the smallest dim
                 scale_factor = std::min((double) w / (double) im_w, (double) h / (double) im_h);
                 small_dims[0] = int((double) im_w * scale_factor);
                 small_dims[1] = int((double) im_h * scale_factor);
 
+                // size the decoder scales to, in frame pixels
+                frame_dims[0] = small_dims[0] * sx / CELL_PX_W;
+                frame_dims[1] = small_dims[1] * sy / CELL_PX_H;
+
                 // if the terminal size is invalid
-                if (small_dims[0] <= 0 || small_dims[1] <= 0) {
+                if (frame_dims[0] <= 0 || frame_dims[1] <= 0) {
                     printf(
                         "\x1B[%d;%dHterminal dimensions is too small! (%d, %d)                                                                    \n",
                         msg_y + 1, 1, curr_w, curr_h);
@@ -683,9 +1060,24 @@ int main(int argc, char *argv[]) {
                     printf("\x1B[?25l");
                     printf("terminal dimensions: (w %4d, h %4d)\n", curr_w, curr_h);
                     printf("frame dimensions:    (w %4d, h %4d)\n", im_w, im_h);
-                    printf("display dimensions:  (w %4d, h %4d)\n", small_dims[0], small_dims[1] / (sy / sx));
+                    printf("display dimensions:  (w %4d, h %4d)\n", small_dims[0], small_dims[1] / (CELL_PX_H / CELL_PX_W));
                     printf("scaling:             %f\n", scale_factor);
                     printf("frames per second:   %f\n", fps);
+                    printf("decoder quality:     level %d (%s)\n", cap.get_decode_quality(),
+                           decode_quality_desc[cap.get_decode_quality()]);
+                    if (cap.get_lowres() > 0) printf("decoder lowres:      1/%d\n", 1 << cap.get_lowres());
+                    printf("decoder threads:     %d (%s)\n", cap.get_decode_threads(),
+                           cap.get_decode_thread_type() & FF_THREAD_FRAME ? "frame" :
+                           cap.get_decode_thread_type() & FF_THREAD_SLICE ? "slice" : "none");
+                    printf("scaler threads:      %d\n", cap.get_scale_threads());
+                    if (!use_opencl) {
+                        printf("render threads:      %d\n", render_pool.concurrency());
+                        if (cpu_mse) printf("glyph fit:           mse, %d glyphs\n", DIFF_CASES);
+                        else printf("glyph fit:           %s minimax, %d glyphs\n", glyph_fit_backend(),
+                                    DIFF_CASES - CPU_REDUCED_CHARSET_AMT);
+                    }
+                    printf("frame format:        %s\n", av_get_pix_fmt_name(frame_fmt));
+                    printf("input:               %s\n", cap.get_io_backend_name());
                     if (cap.has_audio()) {
                         printf("audio:               enabled (%d Hz, %d channels)\n",
                                cap.get_audio_sample_rate(),
@@ -696,7 +1088,7 @@ int main(int argc, char *argv[]) {
                     fflush(stdout);
 
                     // wait one second so the info can be read
-                    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+                    if (!fast_start) std::this_thread::sleep_for(std::chrono::milliseconds(1000));
 
                     // set actual reference times
                     start = std::chrono::steady_clock::now();
@@ -704,180 +1096,70 @@ int main(int argc, char *argv[]) {
                 }
 
                 // set the video resize dimensions
-                cap.setResize(small_dims[0], small_dims[1]);
-                int video_height = cap.get_height() / sy;
-                int video_width = cap.get_width() / sx;
+                frames.resize(frame_dims[0], frame_dims[1]);
+                int video_height = frame_dims[1] / sy;
+                int video_width = frame_dims[0] / sx;
                 int term_video_chars = video_width * video_height;
 
-                // reallocate up old frame data if they were allocated
-                if (alloc) {
-                    auto *realloc_frame = static_cast<char *>(std::realloc(frame, cap.get_dst_buf_size()));
-                    auto *realloc_old = static_cast<char *>(std::realloc(old, cap.get_dst_buf_size()));
-                    print_buffer_size = curr_w * curr_h * 60;
-                    auto *realloc_print_buf = static_cast<char *>(std::realloc(print_buf, print_buffer_size));
-                    auto *realloc_error = static_cast<float *>(std::realloc(
-                        error_buffer, term_video_chars * 3 * sizeof(float)));
-
-                    char *realloc_render_buf = nullptr;
-                    {
-                        std::lock_guard<std::mutex> lock(render_buffer_mutex);
-                        realloc_render_buf = static_cast<char *>(std::realloc(render_buffer, print_buffer_size));
-                    }
-
-                    auto *realloc_indices = static_cast<int *>(std::realloc(
-                        char_indices, term_video_chars * sizeof(int)));
-
-#ifdef HAVE_OPENCL
-                    // realloc opencl buffers
-                    auto *realloc_fg_colors = static_cast<int *>(
-                        std::realloc(fg_colors, term_video_chars * sizeof(int)));
-                    auto *realloc_bg_colors = static_cast<int *>(
-                        std::realloc(bg_colors, term_video_chars * sizeof(int)));
-                    auto *realloc_needs_update = static_cast<bool *>(std::realloc(
-                        needs_update, term_video_chars * sizeof(bool)));
-
-                    if (realloc_frame && realloc_old && realloc_print_buf && realloc_error
-                        && realloc_fg_colors && realloc_bg_colors && realloc_needs_update && realloc_render_buf ) {
-#else
-                        if (realloc_frame && realloc_old && realloc_print_buf && realloc_error && realloc_indices && realloc_render_buf ) {
-#endif
-                        frame = realloc_frame;
-                        old = realloc_old;
-                        print_buf = realloc_print_buf;
-
-                        {
-                            std::lock_guard<std::mutex> lock(render_buffer_mutex);
-                            render_buffer = realloc_render_buf;
-                            render_buffer_size = print_buffer_size;
-                        }
-
-                        error_buffer = realloc_error;
-                        char_indices = realloc_indices;
-#ifdef HAVE_OPENCL
-                        fg_colors = realloc_fg_colors;
-                        bg_colors = realloc_bg_colors;
-                        needs_update = realloc_needs_update;
-#endif
-
-                        // clear reallocated buffers
-                        memset(error_buffer, 0, term_video_chars * 3 * sizeof(float));
-                        memset(old, 0, cap.get_dst_buf_size());
-                    } else {
-                        // Free whatever succeeded before the failure
-                        if (realloc_frame) std::free(realloc_frame);
-                        else std::free(frame);
-
-                        if (realloc_old) std::free(realloc_old);
-                        else std::free(old);
-
-                        if (realloc_print_buf) std::free(realloc_print_buf);
-                        else std::free(print_buf);
-
-                        if (realloc_render_buf) {
-                            std::lock_guard<std::mutex> lock(render_buffer_mutex);
-                            std::free(realloc_render_buf);
-                        } else {
-                            std::lock_guard<std::mutex> lock(render_buffer_mutex);
-                            std::free(render_buffer);
-                        }
-
-                        if (realloc_error) std::free(realloc_error);
-                        else std::free(error_buffer);
-                        if (realloc_indices) std::free(realloc_indices);
-                        else std::free(char_indices);
-#ifdef HAVE_OPENCL
-                        // free successfull allocated opencl buffers
-                        if (realloc_fg_colors) std::free(realloc_fg_colors);
-                        else std::free(fg_colors);
-                        if (realloc_bg_colors) std::free(realloc_bg_colors);
-                        else std::free(bg_colors);
-                        if (realloc_needs_update) std::free(realloc_needs_update);
-                        else std::free(needs_update);
-#endif
-
-                        fprintf(stderr, "failed to reallocate buffers on terminal resize\n");
-                        alloc = false;
-                        break;
-                    }
-                } else {
-                    // otherwise create new frame buffers
-                    frame = static_cast<char *>(std::malloc(cap.get_dst_buf_size()));
-                    old = static_cast<char *>(std::calloc(cap.get_dst_buf_size(), sizeof(char)));
-                    // allocate print buffer
-                    // worst case: every single character update with color codes
-                    // and every single character needs a cursor move
-                    print_buffer_size = curr_w * curr_h * 60; // 60 bytes per char with safety margin
-                    print_buf = static_cast<char *>(malloc(print_buffer_size));
-                    // acquire lock and allocate render buffer
-                    char *temp_render_buffer = nullptr;
-                    {
-                        std::lock_guard<std::mutex> lock(render_buffer_mutex);
-                        render_buffer_size = print_buffer_size;
-                        temp_render_buffer = static_cast<char *>(malloc(render_buffer_size));
-                        render_buffer = temp_render_buffer;
-                    }
-
-                    // allocate dithering error buffer
-                    error_buffer = static_cast<float *>(std::calloc(term_video_chars * 3, sizeof(float)));
-                    char_indices = static_cast<int *>(std::malloc(term_video_chars * sizeof(int)));
-
-#ifdef HAVE_OPENCL
-                    // Allocate OpenCL buffers
-                    fg_colors = static_cast<int *>(std::malloc(term_video_chars * sizeof(int)));
-                    bg_colors = static_cast<int *>(std::malloc(term_video_chars * sizeof(int)));
-                    needs_update = static_cast<bool *>(std::malloc(term_video_chars * sizeof(bool)));
-
-                    if (frame && old && print_buf && error_buffer
-                        && fg_colors && bg_colors && needs_update) {
-#else
-                        if (frame && old && print_buf && error_buffer && char_indices) {
-#endif
-                        alloc = true;
-                    } else {
-                        // clean up partial allocations
-                        if (frame) std::free(frame);
-                        if (old) std::free(old);
-                        if (print_buf) std::free(print_buf);
-                        if (temp_render_buffer) {
-                            std::lock_guard<std::mutex> lock(render_buffer_mutex);
-                            std::free(render_buffer);
-                            render_buffer = nullptr;
-                        }
-                        if (error_buffer) std::free(error_buffer);
-                        if (char_indices) std::free(char_indices);
-
-#ifdef HAVE_OPENCL
-                        // cleanup partial opencl allocations
-                        if (fg_colors) std::free(fg_colors);
-                        if (bg_colors) std::free(bg_colors);
-                        if (needs_update) std::free(needs_update);
-#endif
-
-                        alloc = false;
-                        fprintf(stderr, "failed to allocate buffers\n");
-                        break;
-                    }
+                // every buffer that depends on the geometry lives in one arena, a new one is built
+                // for the new size and swapped in, so there is no partial reallocation to undo
+                // worst case: every single character update with color codes
+                // and every single character needs a cursor move
+                print_buffer_size = curr_w * curr_h * PRINT_BYTES_PER_CELL;
+                auto *next_arena = new frame_arena(print_buffer_size, term_video_chars,
+                                                   use_opencl ? term_video_chars : 0, huge_pages);
+                if (!next_arena->is_allocated()) {
+                    delete next_arena;
+                    fprintf(stderr, alloc ? "failed to reallocate buffers on terminal resize\n"
+                                          : "failed to allocate buffers\n");
+                    alloc = false;
+                    break;
                 }
 
-                // set the entire screen to black
-                written = snprintf(print_buf, print_buffer_size, "\x1B[2J\x1B[H\x1B[48;2;0;0;0m");
+                // the write thread only touches the render buffer under this lock
+                {
+                    std::lock_guard<std::mutex> lock(render_buffer_mutex);
+                    std::swap(arena, next_arena);
+                    render_buffer = arena->render_buffer;
+                    render_buffer_size = print_buffer_size;
+                    render_buffer_written = 0;
+                    frame_ready = false;
+                    // set the entire screen to black before the first frame at the new size
+                    clear_screen_pending = true;
+                    // next_arena now holds the previous geometry, nullptr on the first layout
+                    delete next_arena;
+                }
 
-                // one write call for frame
-                write(STDOUT_FILENO, print_buf, written);
+                screen = arena->screen;
+                print_buf = arena->print_buf;
+                error_buffer = arena->error_buffer;
+                dither_carry = arena->dither_carry;
+                char_indices = arena->char_indices;
+                fg_colors = arena->fg_colors;
+                bg_colors = arena->bg_colors;
+                needs_update = arena->needs_update;
+                alloc = true;
+
+                // the clear leaves the background black and the foreground as it was
+                for (int k = 0; k < 3; k++) sgr_bg[k] = 0;
             }
 
             if (!alloc) break;
 
-            // get frame from video
-            decode_start = std::chrono::steady_clock::now();
-            int ret = cap.get_frame(small_dims[0], small_dims[1], frame);
-            decode_end = std::chrono::steady_clock::now();
-            decode_time = (int) std::chrono::duration_cast<std::chrono::microseconds>(decode_end - decode_start).count();
-            total_decode_time += decode_time;
+            // get the next decoded frame, this only blocks if the decode thread has fallen behind
+            int ret = frames.pop(frame_dims[0], frame_dims[1], frame_buf);
+            decode_time = frames.get_last_decode_time();
+            decode_stall_time = frames.get_last_stall_time();
+            total_decode_time = frames.get_total_decode_time();
+            total_decode_stall_time = frames.get_total_stall_time();
+            total_io_wait_time = cap.get_io_wait_time();
 
             // decay error buffer to prevent temporal ghosting
-            int video_height = cap.get_height() / sy;
-            int video_width = cap.get_width() / sx;
+            int video_height = frame_dims[1] / sy;
+            int video_width = frame_dims[0] / sx;
+            // cells past the edge of a terminal which is being resized are left out
+            const int visible_w = std::min(video_width, view_w);
+            const int visible_h = std::min(video_height, view_h - 1);
             if (!use_opencl) {
                 if (error_buffer && dither_enable) {
                     for (int i = 0; i < video_height * video_width * 3; i++) {
@@ -902,64 +1184,110 @@ int main(int argc, char *argv[]) {
                 frame_times.pop();
             }
 
-            // if there is still time before the next frame, wait a bit
-            if (curr_frame * period - elapsed > 0)
-                std::this_thread::sleep_until(
-                    std::chrono::microseconds(curr_frame * period - elapsed - avg_frame_times_sum / frame_times.size())
-                    +
-                    stop);
-            else {
-                // if the next frame is overdue, skip the frame and wait till the earliest non-overdue frame
-                skip = static_cast<double>(elapsed) / static_cast<double>(period) - static_cast<double>(curr_frame);
-                for (int i = 0; i < std::floor(skip); i++) ret = cap.get_frame(small_dims[0], small_dims[1], frame);
-                dropped += std::floor(skip);
-                curr_frame += std::floor(skip);
-                std::this_thread::sleep_until(
-                    std::chrono::microseconds(curr_frame * period - avg_frame_times_sum / frame_times.size()) +
-                    video_start);
-            }
+            // schedule the frame by its timestamp against the master clock
+            if (ret == 0) {
+                // the media clock starts at the first frame, which is shown as soon as it is decoded
+                if (!clock_started) {
+                    clock_started = true;
+                    clock_media = frame_buf.pts;
+                    clock_wall = std::chrono::steady_clock::now();
+                    cap.start_audio();
+                }
 
-            // set the previous pixel bg colour and font colour to a large value to force the ansi colour command to be printed
-            // for the first pixel in each frame
-            prevpixelbg[0] = 1000;
-            prevpixelbg[1] = 1000;
-            prevpixelbg[2] = 1000;
-            prevpixel[0] = 1000;
-            prevpixel[1] = 1000;
-            prevpixel[2] = 1000;
+                const double frame_duration = static_cast<double>(period) / 1000000.0;
+                double delay = frame_buf.pts - master_clock();
+
+                // if the frame is overdue by more than a frame, drop it along with the frames
+                // after it that are overdue as well, and show the first one which is not
+                skip = -delay / frame_duration;
+                if (std::floor(skip) >= 1) {
+                    frames.skip(static_cast<int>(std::floor(skip)) - 1);
+                    ret = frames.pop(frame_dims[0], frame_dims[1], frame_buf);
+                    dropped += std::floor(skip);
+                    curr_frame += std::floor(skip);
+                }
+
+                // the frame after a skip may be missing, then there is nothing to schedule
+                if (ret == 0) {
+                    delay = frame_buf.pts - master_clock();
+
+                    // a jump far ahead is a timestamp discontinuity, so move the clock instead of waiting it out
+                    // the audio clock can not be moved, while it is the master the wait is only capped
+                    // and the frames after it keep waiting until the audio reaches them
+                    if (delay > MAX_FRAME_WAIT) {
+                        double audio_time;
+                        if (cap.get_audio_clock(audio_time)) {
+                            delay = MAX_FRAME_WAIT;
+                        } else {
+                            clock_media = frame_buf.pts;
+                            clock_wall = std::chrono::steady_clock::now();
+                            delay = 0;
+                        }
+                    }
+
+                    // wake up early by the time the last frame took to render, so it is printed on time
+                    double wait = delay - static_cast<double>(rendering_time) / 1000000.0;
+                    if (wait > 0) std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+
+                    double drift = std::abs(frame_buf.pts - master_clock()) * 1000.0;
+                    av_drift_sum += drift;
+                    av_drift_max = std::max(av_drift_max, drift);
+                    av_drift_frames++;
+                }
+            }
 
             // if the video is over, break
-            if (cap.is_end_of_stream()) break;
+            if (frames.is_end_of_stream()) break;
             // if the frame is empty, break immediately
             if (ret < 0) {
                 printf("\x1B[0mError reading video stream or file\n");
                 break;
             }
+            // the frame is not at the current size and frame_buf may point at a slot which was
+            // already returned, so nothing is rendered until a frame at this size is popped
+            if (ret == 1) {
+                count--;
+                curr_frame--;
+                continue;
+            }
 
-            // force the first pixel to use the ansi cursor move command
-            r = -1;
-            c = -1;
+            frame = reinterpret_cast<char *>(frame_buf.data[0]);
+            frame_stride = frame_buf.linesize[0];
 
             // reset snprintf buffer
             written = 0;
             // reset cursor moves tracking
             cursor_moves = 0;
+            sgr_saved = 0;
             // start tracking render time
             render_start = std::chrono::steady_clock::now();
 
 #ifdef HAVE_OPENCL
             if (use_opencl) {
                 ocl.processFrame(
-                    frame, old, old,
-                    cap.get_width(), cap.get_height(),
+                    frame,
+                    frame_dims[0], frame_dims[1],
                     video_width, video_height,
                     diff_threshold, refresh, dither_enable,
-                    char_indices, fg_colors, bg_colors, needs_update
+                    char_indices, fg_colors, bg_colors, needs_update,
+                    sx, sy, frame_stride
                 );
 
                 // generate print output from opencl results
-                for (int ay = 0; ay < video_height; ay++) {
-                    for (int x = 0; x < video_width; x++) {
+                // every cell fits in ANSI_MAX_CELL_BYTES, so the whole frame is checked once up front
+                if (video_width * video_height * ANSI_MAX_CELL_BYTES > print_buffer_size - written) {
+                    fprintf(stderr, "print buffer too small for %d cells\n", video_width * video_height);
+                    break;
+                }
+                // the cursor position is unknown until the first move, which is absolute,
+                // the colours are still the ones the last frame left set
+                ansi_emitter emit(print_buf + written, view_w);
+                emit.use_runs(use_rep, use_ech);
+                emit.set_sgr(sgr_bg, sgr_fg);
+                const int *prevpixelbg = emit.background_color();
+                const int *prevpixel = emit.foreground_color();
+                for (int ay = 0; ay < visible_h; ay++) {
+                    for (int x = 0; x < visible_w; x++) {
                         int char_idx = ay * video_width + x;
 
                         // for characters which need update, compute the colors
@@ -974,8 +1302,6 @@ int main(int argc, char *argv[]) {
                             pixelbg[1] = (bg_colors[char_idx] >> 8) & 0xFF;
                             pixelbg[0] = bg_colors[char_idx] & 0xFF;
 
-                            shapechar = characters[char_indices[char_idx]];
-
                             bgsame = false;
                             pixelsame = false;
                             diffbg = perceptual_diff(
@@ -990,62 +1316,30 @@ int main(int argc, char *argv[]) {
                             if (diffbg < CHANGE_THRESHOLD) {
                                 for (int k = 0; k < 3; k++) pixelbg[k] = prevpixelbg[k];
                                 bgsame = true;
-                            } else {
-                                for (int k = 0; k < 3; k++) prevpixelbg[k] = pixelbg[k];
                             }
 
                             if (diffpixel < CHANGE_THRESHOLD) {
                                 for (int k = 0; k < 3; k++) pixelchar[k] = prevpixel[k];
                                 pixelsame = true;
-                            } else {
-                                for (int k = 0; k < 3; k++) prevpixel[k] = pixelchar[k];
                             }
 
-                            if (r != ay || c != x) {
+                            bool first_cell = emit.size() == 0;
+                            int move_len = emit.move_to(ay, x);
+                            if (move_len > 0) {
                                 cursor_moves++;
-                                if (written >= print_buffer_size - 1) {
-                                    fprintf(stderr, "print buffer full at %d bytes\n", written);
-                                    break;
-                                }
-                                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                                     "\x1B[%d;%dH", ay + 1, x + 1);
-                                if (print_ret > 0 && print_ret < print_buffer_size - written) {
-                                    written += print_ret;
-                                    rendered_cursor_moves++;
-                                    rendered_cursor_chars += print_ret;
-                                }
+                                rendered_cursor_moves++;
+                                rendered_cursor_chars += move_len;
                             }
 
-                            if (written >= print_buffer_size - 1) {
-                                fprintf(stderr, "print buffer full at %d bytes\n", written);
-                                break;
-                            }
-                            if (!bgsame && !pixelsame)
-                                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                                     "\x1B[48;2;%d;%d;%d;38;2;%d;%d;%dm%s",
-                                                     pixelbg[2], pixelbg[1], pixelbg[0],
-                                                     pixelchar[2], pixelchar[1], pixelchar[0], shapechar);
-                            else if (!bgsame)
-                                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                                     "\x1B[48;2;%d;%d;%dm%s",
-                                                     pixelbg[2], pixelbg[1], pixelbg[0], shapechar);
-                            else if (!pixelsame)
-                                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                                     "\x1B[38;2;%d;%d;%dm%s",
-                                                     pixelchar[2], pixelchar[1], pixelchar[0], shapechar);
-                            else
-                                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                                     "%s", shapechar);
-
-                            if (print_ret > 0 && print_ret < print_buffer_size - written)
-                                written += print_ret;
-
-                            r = ay;
-                            c = x + 1;
-                            if (c == curr_w) {
-                                c = 0;
-                                r++;
-                            }
+                            // the emitter takes note of the colours it sets
+                            int sgr_start = emit.size();
+                            if (!bgsame && !pixelsame) emit.colors(pixelbg, pixelchar);
+                            else if (!bgsame) emit.background(pixelbg);
+                            else if (!pixelsame) emit.foreground(pixelchar);
+                            // without the colours from the last frame the first cell sets both of them
+                            if (first_cell)
+                                sgr_saved += ansi_emitter::colors_length(pixelbg, pixelchar) - (emit.size() - sgr_start);
+                            emit.glyph(char_indices[char_idx]);
                         }
 
                         // track which character is used
@@ -1053,272 +1347,451 @@ int main(int argc, char *argv[]) {
                         char_usage[char_indices[char_idx]]++;
                     }
                 }
+                emit.flush();
+                written += emit.size();
+                for (int k = 0; k < 3; k++) {
+                    sgr_bg[k] = prevpixelbg[k];
+                    sgr_fg[k] = prevpixel[k];
+                }
             } else {
-                // variables to store the pointer to the start of each row for easier reference
-                // each pixel uses CHAR_Y rows of the actual image
-                char *row[CHAR_Y];
-                char *oldrow[CHAR_Y];
 #endif
-                for (int ay = 0; ay < video_height; ay++) {
-                    // set the row pointers
-                    for (int i = 0; i < CHAR_Y; i++) {
-                        row[i] = frame + (ay * sy + i * skipy) * 3 * cap.get_width();
-                        oldrow[i] = old + (ay * sy + i * skipy) * 3 * cap.get_width();
-                    }
-                    for (int x = 0; x < video_width; x++) {
-                        // get the colour values of the pixels of the current character
-                        for (int i = 0; i < CHAR_Y; i++)
-                            for (int j = 0; j < CHAR_X; j++)
-                                for (int k = 0; k < 3; k++) {
-                                    pixel[i][j][k] = static_cast<unsigned char>(*(
-                                        row[i] + (x * sx + j * skipx) * 3 + k));
-
-                                    if (dither_enable) {
-                                        // apply error from previous character
-                                        int err_idx = (ay * video_width + x) * 3 + k;
-                                        pixel[i][j][k] = std::clamp(
-                                            pixel[i][j][k] + static_cast<int>(error_buffer[err_idx]), 0, 255);
-                                    }
-                                }
+                // the cell rows are split into bands which are rendered in parallel, each into its
+                // own slice of print_buf. every band starts with an explicit cursor move and, below
+                // the first band, full colour codes, so the slices only have to be joined back together in order
+                int bands = std::clamp(video_height / CPU_BAND_MIN_ROWS, 1,
+                                       render_pool.concurrency() * CPU_BANDS_PER_THREAD);
+                band_outputs.assign(bands, band_output());
+                for (int band = 0; band < bands; band++) {
+                    band_outputs[band].row_begin = video_height * band / bands;
+                    band_outputs[band].row_end = video_height * (band + 1) / bands;
+                    band_outputs[band].offset = band_outputs[band].row_begin * video_width * PRINT_BYTES_PER_CELL;
+                }
 
-                        diff = 0;
-                        // if a refresh is necessary, set the diff to the max diff
-                        if (refresh) {
-                            diff = 255;
-                        } else {
-                            // otherwise, otherwise, calculate the perceptual weighted color differences
-                            // in the RGB values between the actual video frame and what is on screen
-                            // for each pixel that makes up the character
-                            for (int i = 0; i < CHAR_Y; i++)
-                                for (int j = 0; j < CHAR_X; j++) {
-                                    int old_b = static_cast<unsigned char>(*(oldrow[i] + (x * sx + j * skipx) * 3 + 0));
-                                    int old_g = static_cast<unsigned char>(*(oldrow[i] + (x * sx + j * skipx) * 3 + 1));
-                                    int old_r = static_cast<unsigned char>(*(oldrow[i] + (x * sx + j * skipx) * 3 + 2));
-
-                                    diff = std::max(diff, perceptual_diff(
-                                                        old_r, old_g, old_b,
-                                                        pixel[i][j][2], pixel[i][j][1], pixel[i][j][0]
-                                                    ));
-                                }
+                auto render_band = [&](int band) {
+                    band_output &out = band_outputs[band];
+                    const int row_begin = out.row_begin;
+                    const int row_end = out.row_end;
+                    // the slice has PRINT_BYTES_PER_CELL for every cell of the band, which is more
+                    // than any cell can take, so the emitter never has to check
+                    ansi_emitter emit(print_buf + out.offset, view_w);
+                    emit.use_runs(use_rep, use_ech);
+                    // only the first band knows the colours it starts with, the ones the last frame left set
+                    if (band == 0) emit.set_sgr(sgr_bg, sgr_fg);
+                    const int *prevpixelbg = emit.background_color();
+                    const int *prevpixel = emit.foreground_color();
+                    int band_cursor_moves = 0;
+
+                    // error diffusion can not cross into the band below while it is being rendered,
+                    // so what would land in its rows is kept aside and added once all bands are done.
+                    // that error only takes effect on the next frame, the same as it does for the
+                    // first row of a frame, and with a single band nothing changes
+                    auto diffuse = [&](int ey, int ex, int k, float e) {
+                        float *dst = ey < row_end ? error_buffer : dither_carry;
+                        dst[(ey * video_width + ex) * 3 + k] += e;
+                    };
+
+                    // per band copies of the working state used by the serial path
+                    int pixel[CHAR_Y][CHAR_X][3];
+                    // the same pixels one plane per channel, as the glyph fit takes them
+                    alignas(32) uint8_t samples[3][GLYPH_FIT_PIXELS];
+                    float linear_samples[3][GLYPH_FIT_PIXELS];
+                    int cases[DIFF_CASES];
+                    int diff, mindiff, diffbg, diffpixel, case_min;
+                    bool bgsame, pixelsame;
+                    int pixelbg[3], pixelchar[3];
+
+                    // variables to store the pointer to the start of each row for easier reference
+                    // each pixel uses CHAR_Y rows of the actual image
+                    char *row[CHAR_Y];
+                    // planar frames keep the luma rows in row and the chroma rows here
+                    char *row_u[CHAR_Y], *row_v[CHAR_Y];
+                    // with planar frames only luma decides the glyph, chroma only decides the colours
+                    const int fit_channels = planar ? 1 : 3;
+                    for (int ay = row_begin; ay < std::min(row_end, visible_h); ay++) {
+                        // set the row pointers
+                        for (int i = 0; i < CHAR_Y; i++) {
+                            row[i] = frame + (ay * sy + i * skipy) * frame_stride;
+                            if (planar) {
+                                int cy = (ay * sy + i * skipy) >> chroma_shift;
+                                row_u[i] = reinterpret_cast<char *>(frame_buf.data[1]) + cy * frame_buf.linesize[1];
+                                row_v[i] = reinterpret_cast<char *>(frame_buf.data[2]) + cy * frame_buf.linesize[2];
+                            }
                         }
+                        for (int x = 0; x < visible_w; x++) {
+                            // get the colour values of the pixels of the current character
+                            for (int i = 0; i < CHAR_Y; i++)
+                                for (int j = 0; j < CHAR_X; j++)
+                                    for (int k = 0; k < 3; k++) {
+                                        int px = x * sx + j * skipx;
+                                        if (planar) {
+                                            char *src = k == 0 ? row[i] + px
+                                                               : (k == 1 ? row_u[i] : row_v[i]) + (px >> chroma_shift);
+                                            pixel[i][j][k] = static_cast<unsigned char>(*src);
+                                        } else {
+                                            pixel[i][j][k] = static_cast<unsigned char>(*(row[i] + px * 3 + k));
+                                        }
 
-                        int char_idx = ay * video_width + x;
-
-                        // if the difference exceeds the set threshold, reprint the entire character
-                        if (diff >= diff_threshold) {
-                            for (int &case_it: cases) case_it = 0;
-
-                            // calculate for each unicode character, the max error between what
-                            // will be printed on screen and the actual video pixel if the character were used
-                            // for the cpu version, just use max, the opencl version can use MSE
-                            for (int k = 0; k < 3; k++) {
-                                for (int case_it = 0; case_it < DIFF_CASES - CPU_REDUCED_CHARSET_AMT; case_it++) {
-                                    min_fg = 256;
-                                    min_bg = 256;
-                                    max_fg = 0;
-                                    max_bg = 0;
-                                    // for every character, there is a foreground colour and background colour
-                                    // so we just check for the max and the min of all the values for pixels which
-                                    // belong to the foreground and background regions respectively
-                                    // the diff between the max and the min is the max error
-                                    for (int i = 0; i < CHAR_Y; i++)
-                                        for (int j = 0; j < CHAR_X; j++) {
-                                            if (pixelmap[case_it][i * CHAR_X + j]) {
-                                                min_fg = std::min(min_fg, pixel[i][j][k]);
-                                                max_fg = std::max(max_fg, pixel[i][j][k]);
-                                            } else {
-                                                min_bg = std::min(min_bg, pixel[i][j][k]);
-                                                max_bg = std::max(max_bg, pixel[i][j][k]);
-                                            }
+                                        if (dither_enable) {
+                                            // apply error from previous character
+                                            int err_idx = (ay * video_width + x) * 3 + k;
+                                            pixel[i][j][k] = std::clamp(
+                                                pixel[i][j][k] + static_cast<int>(error_buffer[err_idx]), 0, 255);
                                         }
-                                    cases[case_it] = std::max(cases[case_it],
-                                                              std::max(max_fg - min_fg, max_bg - min_bg));
-                                }
-                            }
+                                        samples[k][i * CHAR_X + j] = static_cast<uint8_t>(pixel[i][j][k]);
+                                    }
 
-                            // choose the unicode char to print which minimises the diff
-                            mindiff = 256;
-                            case_min = 0;
-                            for (int case_it = 0; case_it < DIFF_CASES - CPU_REDUCED_CHARSET_AMT; case_it++) {
-                                if (cases[case_it] < mindiff) {
-                                    case_min = case_it;
-                                    mindiff = cases[case_it];
-                                }
+                            int char_idx = ay * video_width + x;
+                            screen_cell &cell = screen[char_idx];
+
+                            diff = 0;
+                            // if a refresh is necessary, set the diff to the max diff
+                            if (refresh) {
+                                diff = 255;
+                            } else {
+                                // otherwise, calculate the perceptual weighted color differences
+                                // between the actual video frame and what is on screen for each pixel
+                                // that makes up the character. the on screen pixel is the fg or bg
+                                // colour of the cell, depending on the glyph mask
+                                const uint64_t on_screen = glyph_masks[cell.glyph];
+                                for (int i = 0; i < CHAR_Y; i++)
+                                    for (int j = 0; j < CHAR_X; j++) {
+                                        const uint8_t *old_px = (on_screen >> (i * CHAR_X + j)) & 1 ? cell.fg : cell.bg;
+                                        if (planar)
+                                            diff = std::max(diff, yuv_diff(
+                                                                old_px[0], old_px[1], old_px[2],
+                                                                pixel[i][j][0], pixel[i][j][1], pixel[i][j][2]
+                                                            ));
+                                        else
+                                            diff = std::max(diff, perceptual_diff(
+                                                                old_px[2], old_px[1], old_px[0],
+                                                                pixel[i][j][2], pixel[i][j][1], pixel[i][j][0]
+                                                            ));
+                                    }
                             }
 
-                            // track which char is used for this position
-                            char_indices[char_idx] = case_min;
-                            shapechar = characters[case_min];
+                            // if the difference exceeds the set threshold, reprint the entire character
+                            if (diff >= diff_threshold) {
+                                // a flat cell has nothing for a glyph to show, any glyph with both
+                                // colours the same stands in for the blank on screen
+                                const bool flat = cell_is_flat(samples);
+                                if (flat) {
+                                    case_min = 0;
+                                } else if (cpu_mse) {
+                                    // the full glyph set scored by squared error, in linear light like
+                                    // the opencl kernel. planar frames are fitted on luma as it is
+                                    for (int k = 0; k < fit_channels; k++)
+                                        for (int p = 0; p < GLYPH_FIT_PIXELS; p++)
+                                            linear_samples[k][p] = planar ? samples[k][p] / 255.0f
+                                                                          : srgb_to_linear(samples[k][p]);
+                                    case_min = glyph_fit_mse(linear_samples, fit_channels, DIFF_CASES);
+                                } else {
+                                    // calculate for each unicode character, the max error between what
+                                    // will be printed on screen and the actual video pixel if the character were used
+                                    glyph_fit_minimax(samples, fit_channels, DIFF_CASES - CPU_REDUCED_CHARSET_AMT, cases);
+
+                                    // choose the unicode char to print which minimises the diff
+                                    mindiff = 256;
+                                    case_min = 0;
+                                    for (int case_it = 0; case_it < DIFF_CASES - CPU_REDUCED_CHARSET_AMT; case_it++) {
+                                        if (cases[case_it] < mindiff) {
+                                            case_min = case_it;
+                                            mindiff = cases[case_it];
+                                        }
+                                    }
+                                }
 
-                            diffbg = 0;
-                            diffpixel = 0;
-                            bgsame = false;
-                            pixelsame = false;
+                                // track which char is used for this position
+                                char_indices[char_idx] = flat ? ANSI_BLANK : case_min;
+
+                                diffbg = 0;
+                                diffpixel = 0;
+                                bgsame = false;
+                                pixelsame = false;
+
+                                // based on the unicode character selected, find the avg colour of the pixels
+                                // in the foreground region and background region
+                                // the avg colour will be used as the colour to be printed
+                                if (flat) {
+                                    int mean[3];
+                                    for (int k = 0; k < 3; k++) {
+                                        int sum = 0;
+                                        for (int p = 0; p < GLYPH_FIT_PIXELS; p++) sum += samples[k][p];
+                                        mean[k] = (sum + GLYPH_FIT_PIXELS / 2) / GLYPH_FIT_PIXELS;
+                                    }
+                                    if (planar) yuv_to_bgr(mean, pixelbg);
+                                    else
+                                        for (int k = 0; k < 3; k++) pixelbg[k] = mean[k];
+                                    for (int k = 0; k < 3; k++) pixelchar[k] = pixelbg[k];
+                                } else if (planar) {
+                                    // average in yuv and convert just the two resulting colours
+                                    int yuv_fg[3] = {0, 0, 0};
+                                    int yuv_bg[3] = {0, 0, 0};
+                                    const int fg_count = glyph_fg_count[case_min];
+                                    const int bg_count = CHAR_Y * CHAR_X - fg_count;
 
-                            // based on the unicode character selected, find the avg colour of the pixels
-                            // in the foreground region and background region
-                            // the avg colour will be used as the colour to be printed
-                            float linear_fg[3] = {0, 0, 0};
-                            float linear_bg[3] = {0, 0, 0};
-                            int bg_count = 0, fg_count = 0;
+                                    for (int i = 0; i < CHAR_Y; i++)
+                                        for (int j = 0; j < CHAR_X; j++) {
+                                            int *sum = glyph_is_fg(case_min, i * CHAR_X + j) ? yuv_fg : yuv_bg;
+                                            for (int k = 0; k < 3; k++) sum[k] += pixel[i][j][k];
+                                        }
 
-                            for (int i = 0; i < CHAR_Y; i++)
-                                for (int j = 0; j < CHAR_X; j++) {
-                                    if (pixelmap[case_min][i * CHAR_X + j]) {
-                                        for (int k = 0; k < 3; k++)
-                                            linear_fg[k] += srgb_to_linear(pixel[i][j][k]);
-                                        fg_count++;
-                                    } else {
-                                        for (int k = 0; k < 3; k++)
-                                            linear_bg[k] += srgb_to_linear(pixel[i][j][k]);
-                                        bg_count++;
+                                    for (int k = 0; k < 3; k++) {
+                                        yuv_fg[k] /= std::max(fg_count, 1);
+                                        yuv_bg[k] /= std::max(bg_count, 1);
                                     }
-                                }
-
-                            for (int k = 0; k < 3; k++) {
-                                pixelchar[k] = linear_to_srgb(linear_fg[k] / static_cast<float>(fg_count));
-                                pixelbg[k] = linear_to_srgb(linear_bg[k] / static_cast<float>(bg_count));
-                            }
+                                    yuv_to_bgr(yuv_fg, pixelchar);
+                                    yuv_to_bgr(yuv_bg, pixelbg);
+                                } else {
+                                    float linear_fg[3] = {0, 0, 0};
+                                    float linear_bg[3] = {0, 0, 0};
+                                    const int fg_count = glyph_fg_count[case_min];
+                                    const int bg_count = CHAR_Y * CHAR_X - fg_count;
 
-                            // find the max diff between the foreground and background colours
-                            // of the previously printed character
-                            diffbg = perceptual_diff(
-                                prevpixelbg[2], prevpixelbg[1], prevpixelbg[0],
-                                pixelbg[2], pixelbg[1], pixelbg[0]
-                            );
-                            diffpixel = perceptual_diff(
-                                prevpixel[2], prevpixel[1], prevpixel[0],
-                                pixelchar[2], pixelchar[1], pixelchar[0]
-                            );
+                                    for (int i = 0; i < CHAR_Y; i++)
+                                        for (int j = 0; j < CHAR_X; j++) {
+                                            float *sum = glyph_is_fg(case_min, i * CHAR_X + j) ? linear_fg : linear_bg;
+                                            for (int k = 0; k < 3; k++) sum[k] += srgb_to_linear(pixel[i][j][k]);
+                                        }
 
-                            // if the foreground or background colours are sufficiently similar,
-                            // we don't need to print the ansi command again
+                                    for (int k = 0; k < 3; k++) {
+                                        pixelchar[k] = linear_to_srgb(linear_fg[k] / static_cast<float>(fg_count));
+                                        pixelbg[k] = linear_to_srgb(linear_bg[k] / static_cast<float>(bg_count));
+                                    }
+                                }
 
-                            // but if we skip printing the ansi command to change colour,
-                            // we have to remember to keep track of the actual colour of this character
-                            // on screen, which will be the colour of previous one
-                            if (diffbg < CHANGE_THRESHOLD) {
-                                for (int k = 0; k < 3; k++) pixelbg[k] = prevpixelbg[k];
-                                bgsame = true;
-                            } else
-                                for (int k = 0; k < 3; k++) prevpixelbg[k] = pixelbg[k];
-                            if (diffpixel < CHANGE_THRESHOLD) {
-                                for (int k = 0; k < 3; k++) pixelchar[k] = prevpixel[k];
-                                pixelsame = true;
-                            } else
-                                for (int k = 0; k < 3; k++) prevpixel[k] = pixelchar[k];
+                                // find the max diff between the foreground and background colours
+                                // of the previously printed character
+                                diffbg = perceptual_diff(
+                                    prevpixelbg[2], prevpixelbg[1], prevpixelbg[0],
+                                    pixelbg[2], pixelbg[1], pixelbg[0]
+                                );
+                                diffpixel = perceptual_diff(
+                                    prevpixel[2], prevpixel[1], prevpixel[0],
+                                    pixelchar[2], pixelchar[1], pixelchar[0]
+                                );
+
+                                // if the foreground or background colours are sufficiently similar,
+                                // we don't need to print the ansi command again
+
+                                // but if we skip printing the ansi command to change colour,
+                                // we have to remember to keep track of the actual colour of this character
+                                // on screen, which will be the colour of previous one
+                                if (diffbg < CHANGE_THRESHOLD) {
+                                    for (int k = 0; k < 3; k++) pixelbg[k] = prevpixelbg[k];
+                                    bgsame = true;
+                                }
+                                if (flat) {
+                                    // a blank does not show the foreground, so it is left as it is
+                                    for (int k = 0; k < 3; k++) pixelchar[k] = pixelbg[k];
+                                    pixelsame = true;
+                                } else if (diffpixel < CHANGE_THRESHOLD) {
+                                    for (int k = 0; k < 3; k++) pixelchar[k] = prevpixel[k];
+                                    pixelsame = true;
+                                }
 
-                            // store the actual colour of the character's pixels in a buffer to check diff next time
-                            for (int k = 0; k < 3; k++)
-                                for (int i = 0; i < CHAR_Y; i++)
-                                    for (int j = 0; j < CHAR_X; j++) {
-                                        if (pixelmap[case_min][i * CHAR_X + j])
-                                            *(oldrow[i] + (x * sx + j * skipx) * 3 + k) = static_cast<char>(pixelchar[
-                                                k]);
-                                        else
-                                            *(oldrow[i] + (x * sx + j * skipx) * 3 + k) = static_cast<char>(pixelbg[k]);
+                                // the on screen colours in the colour space of the frame
+                                int screen_fg[3], screen_bg[3];
+                                if (planar) {
+                                    bgr_to_yuv(pixelchar, screen_fg);
+                                    bgr_to_yuv(pixelbg, screen_bg);
+                                } else {
+                                    for (int k = 0; k < 3; k++) {
+                                        screen_fg[k] = pixelchar[k];
+                                        screen_bg[k] = pixelbg[k];
                                     }
+                                }
 
-                            if (dither_enable) {
-                                // diffuse color errors
+                                // remember what the cell now shows to check diff next time
+                                cell.glyph = static_cast<uint8_t>(case_min);
                                 for (int k = 0; k < 3; k++) {
-                                    float total_error = 0;
-                                    for (int i = 0; i < CHAR_Y; i++) {
-                                        for (int j = 0; j < CHAR_X; j++) {
-                                            int target = pixelmap[case_min][i * CHAR_X + j] ? pixelchar[k] : pixelbg[k];
-                                            total_error += static_cast<float>(pixel[i][j][k] - target);
-                                        }
-                                    }
-                                    total_error /= (CHAR_Y * CHAR_X);
+                                    cell.fg[k] = static_cast<uint8_t>(screen_fg[k]);
+                                    cell.bg[k] = static_cast<uint8_t>(screen_bg[k]);
+                                }
 
-                                    // distribute error per channel
-                                    int err_idx_right = (ay * video_width + (x + 1)) * 3 + k;
-                                    int err_idx_below = ((ay + 1) * video_width + x) * 3 + k;
-                                    int err_idx_diag = ((ay + 1) * video_width + (x + 1)) * 3 + k;
+                                if (dither_enable) {
+                                    // diffuse color errors
+                                    for (int k = 0; k < 3; k++) {
+                                        float total_error = 0;
+                                        for (int i = 0; i < CHAR_Y; i++) {
+                                            for (int j = 0; j < CHAR_X; j++) {
+                                                int target = glyph_is_fg(case_min, i * CHAR_X + j) ? screen_fg[k] : screen_bg[k];
+                                                total_error += static_cast<float>(pixel[i][j][k] - target);
+                                            }
+                                        }
+                                        total_error /= (CHAR_Y * CHAR_X);
 
+                                        // distribute error per channel
 #ifdef ATKINSON_DITHERING
-                                    // atkinson dithering
-                                    if (x + 1 < video_width)
-                                        error_buffer[err_idx_right] += total_error * 0.125f;
-                                    if (x + 2 < video_width)
-                                        error_buffer[(ay * video_width + (x + 2)) * 3 + k] += total_error * 0.125f;
-                                    if (ay + 1 < video_height) {
-                                        error_buffer[err_idx_below] += total_error * 0.125f;
-                                        if (x - 1 >= 0)
-                                            error_buffer[((ay + 1) * video_width + (x - 1)) * 3 + k] += total_error *
-                                                    0.125f;
-                                        if (x + 1 < video_width)
-                                            error_buffer[err_idx_diag] += total_error * 0.125f;
-                                    }
-                                    if (ay + 2 < video_height)
-                                        error_buffer[((ay + 2) * video_width + x) * 3 + k] += total_error * 0.125f;
+                                        // atkinson dithering
+                                        if (x + 1 < video_width) diffuse(ay, x + 1, k, total_error * 0.125f);
+                                        if (x + 2 < video_width) diffuse(ay, x + 2, k, total_error * 0.125f);
+                                        if (ay + 1 < video_height) {
+                                            diffuse(ay + 1, x, k, total_error * 0.125f);
+                                            if (x - 1 >= 0) diffuse(ay + 1, x - 1, k, total_error * 0.125f);
+                                            if (x + 1 < video_width) diffuse(ay + 1, x + 1, k, total_error * 0.125f);
+                                        }
+                                        if (ay + 2 < video_height) diffuse(ay + 2, x, k, total_error * 0.125f);
 #else
-                                    // floyd-steinberg dithering
-                                    if (x + 1 < video_width)
-                                        error_buffer[err_idx_right] += total_error * 0.4375f; // 7/16 right
-                                    if (ay + 1 < video_height)
-                                        error_buffer[err_idx_below] += total_error * 0.3125f; // 5/16 below
-                                    if (x + 1 < video_width && ay + 1 < video_height)
-                                        error_buffer[err_idx_diag] += total_error * 0.25f; // 4/16 diagonal
+                                        // floyd-steinberg dithering
+                                        if (x + 1 < video_width)
+                                            diffuse(ay, x + 1, k, total_error * 0.4375f); // 7/16 right
+                                        if (ay + 1 < video_height)
+                                            diffuse(ay + 1, x, k, total_error * 0.3125f); // 5/16 below
+                                        if (x + 1 < video_width && ay + 1 < video_height)
+                                            diffuse(ay + 1, x + 1, k, total_error * 0.25f); // 4/16 diagonal
 #endif
+                                    }
                                 }
-                            }
 
-                            // if the cursor is already in the right position, do not print the ansi move cursor command
-                            // the ansi position command is one indexed
-                            if (r != ay || c != x) {
-                                cursor_moves++;
-                                if (written >= print_buffer_size - 1) {
-                                    fprintf(stderr, "print buffer full at %d bytes\n", written);
-                                    break;
+                                // unchanged cells right before this one which show nothing but the
+                                // background set now can be written over with blanks instead of moved past
+                                int blank_gap = 0;
+                                if (emit.cursor_row() == ay && prevpixelbg[0] != ANSI_SGR_UNKNOWN) {
+                                    int now_bg[3];
+                                    if (planar) {
+                                        bgr_to_yuv(prevpixelbg, now_bg);
+                                    } else {
+                                        for (int k = 0; k < 3; k++) now_bg[k] = prevpixelbg[k];
+                                    }
+                                    for (int gx = x - 1; gx >= emit.cursor_col() && blank_gap < ANSI_MAX_OVERPRINT; gx--) {
+                                        const screen_cell &gap_cell = screen[ay * video_width + gx];
+                                        bool solid = true;
+                                        for (int k = 0; k < 3; k++)
+                                            solid = solid && gap_cell.bg[k] == now_bg[k] && gap_cell.fg[k] == now_bg[k];
+                                        if (!solid) break;
+                                        blank_gap++;
+                                    }
                                 }
-                                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                                     "\x1B[%d;%dH", ay + 1, x + 1);
-                                if (print_ret > 0 && print_ret < print_buffer_size - written) {
-                                    written += print_ret;
-                                    rendered_cursor_moves++;
-                                    rendered_cursor_chars += print_ret;
+
+                                // move the cursor unless it is already in the right position, the band
+                                // does not know where the band above leaves it, so its first move is absolute
+                                int move_start = emit.size();
+                                int move_len = emit.move_to(ay, x, blank_gap);
+                                if (move_len > 0) {
+                                    band_cursor_moves++;
+                                    if (move_start == 0) {
+                                        out.first_move_len = move_len;
+                                        out.first_r = ay;
+                                        out.first_c = x;
+                                    }
+                                    out.rendered_moves++;
+                                    out.rendered_chars += move_len;
                                 }
-                            }
 
-                            // prints background and foreground colour change command, or either of them, or none
-                            // depending on the previously computed difference
-                            // color codes and character
-                            if (written >= print_buffer_size - 1) {
-                                fprintf(stderr, "print buffer full at %d bytes\n", written);
-                                break;
-                            }
-                            if (!bgsame && !pixelsame)
-                                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                                     "\x1B[48;2;%d;%d;%d;38;2;%d;%d;%dm%s",
-                                                     pixelbg[2], pixelbg[1], pixelbg[0],
-                                                     pixelchar[2], pixelchar[1], pixelchar[0], shapechar);
-                            else if (!bgsame)
-                                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                                     "\x1B[48;2;%d;%d;%dm%s",
-                                                     pixelbg[2], pixelbg[1], pixelbg[0], shapechar);
-                            else if (!pixelsame)
-                                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                                     "\x1B[38;2;%d;%d;%dm%s",
-                                                     pixelchar[2], pixelchar[1], pixelchar[0], shapechar);
-                            else
-                                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                                     "%s", shapechar);
-
-                            if (print_ret > 0 && print_ret < print_buffer_size - written)
-                                written += print_ret;
-
-                            // advance the cursor to keep track of where it is
-                            r = ay;
-                            c = x + 1;
-                            if (c == curr_w) {
-                                c = 0;
-                                r++;
+                                // prints background and foreground colour change command, or either of them, or none
+                                // depending on the previously computed difference
+                                // color codes and character
+                                int sgr_start = emit.size();
+                                if (!bgsame && !pixelsame) emit.colors(pixelbg, pixelchar);
+                                else if (!bgsame) emit.background(pixelbg);
+                                else if (!pixelsame) emit.foreground(pixelchar);
+                                if (move_start == 0) {
+                                    int sgr_len = emit.size() - sgr_start;
+                                    if (band == 0) {
+                                        // without the colours from the last frame the first cell sets both
+                                        // of them, or just the background for a blank
+                                        int full = flat ? ansi_emitter::color_length(pixelbg)
+                                                        : ansi_emitter::colors_length(pixelbg, pixelchar);
+                                        out.sgr_saved += full - sgr_len;
+                                    } else if (!flat) {
+                                        // the join may find the band above already left some of them set
+                                        out.first_sgr_at = sgr_start;
+                                        out.first_sgr_len = sgr_len;
+                                        for (int k = 0; k < 3; k++) {
+                                            out.first_bg[k] = pixelbg[k];
+                                            out.first_fg[k] = pixelchar[k];
+                                        }
+                                    }
+                                }
+                                emit.glyph(flat ? ANSI_BLANK : case_min);
                             }
+
+                            // track which character is used even if it is not updated this time
+                            out.char_usage[char_indices[char_idx]]++;
                         }
+                    }
 
-                        // track which character is used even if it is not updated this time
-                        char_usage[char_indices[char_idx]]++;
+                    emit.flush();
+                    out.written = emit.size();
+                    out.cursor_moves = band_cursor_moves;
+                    out.last_r = emit.cursor_row();
+                    out.last_c = emit.cursor_col();
+                    for (int k = 0; k < 3; k++) {
+                        out.last_bg[k] = prevpixelbg[k];
+                        out.last_fg[k] = prevpixel[k];
+                    }
+                };
+                render_pool.run(bands, render_band);
+
+                // join the band slices. a band's leading absolute move is replaced by the shortest
+                // move from where the band above left the cursor when that is shorter, and its
+                // leading colours lose the ones the band above left set already
+                written = 0;
+                int seam_r = -1, seam_c = 0;
+                for (int band = 0; band < bands; band++) {
+                    band_output &out = band_outputs[band];
+                    const char *src = print_buf + out.offset;
+                    int len = out.written;
+                    // the colours follow right after the move, which the move may have shortened
+                    int sgr_at = out.first_sgr_at;
+                    if (len > 0 && out.first_move_len > 0) {
+                        char move[ANSI_MAX_CELL_BYTES];
+                        ansi_emitter seam(move, view_w);
+                        seam.set_cursor(seam_r, seam_c);
+                        int move_len = seam.move_to(out.first_r, out.first_c);
+                        if (move_len < out.first_move_len) {
+                            memcpy(print_buf + written, move, move_len);
+                            written += move_len;
+                            src += out.first_move_len;
+                            len -= out.first_move_len;
+                            sgr_at -= out.first_move_len;
+                            if (move_len == 0) {
+                                out.cursor_moves--;
+                                out.rendered_moves--;
+                            }
+                            out.rendered_chars += move_len - out.first_move_len;
+                        }
+                    }
+                    if (len > 0 && out.first_sgr_len > 0) {
+                        char sgr[ANSI_MAX_CELL_BYTES];
+                        ansi_emitter seam(sgr, view_w);
+                        seam.set_sgr(sgr_bg, sgr_fg);
+                        int sgr_len = seam.restore(out.first_bg, out.first_fg);
+                        if (sgr_len < out.first_sgr_len) {
+                            // whatever comes between the move and the colours stays as it is
+                            if (sgr_at > 0) memmove(print_buf + written, src, sgr_at);
+                            written += sgr_at;
+                            memcpy(print_buf + written, sgr, sgr_len);
+                            written += sgr_len;
+                            src += sgr_at + out.first_sgr_len;
+                            len -= sgr_at + out.first_sgr_len;
+                            out.sgr_saved += out.first_sgr_len - sgr_len;
+                        }
+                    }
+                    if (len > 0) memmove(print_buf + written, src, len);
+                    written += len;
+                    if (out.written > 0) {
+                        seam_r = out.last_r;
+                        seam_c = out.last_c;
+                        for (int k = 0; k < 3; k++) {
+                            sgr_bg[k] = out.last_bg[k];
+                            sgr_fg[k] = out.last_fg[k];
+                        }
+                    }
+                    sgr_saved += out.sgr_saved;
+
+                    cursor_moves += out.cursor_moves;
+                    rendered_cursor_moves += out.rendered_moves;
+                    rendered_cursor_chars += out.rendered_chars;
+                    for (int i = 0; i < ANSI_GLYPHS; i++) char_usage[i] += out.char_usage[i];
+
+                    // fold in the error diffused across the seam above this band
+                    if (dither_enable && band > 0) {
+                        int carry_end = std::min(out.row_begin + 2, video_height) * video_width * 3;
+                        for (int i = out.row_begin * video_width * 3; i < carry_end; i++) {
+                            error_buffer[i] += dither_carry[i];
+                            dither_carry[i] = 0;
+                        }
                     }
                 }
 
@@ -1331,60 +1804,86 @@ int main(int argc, char *argv[]) {
                     count();
             total_render_time += rendering_time;
             // print the fps, avg fps, dropped frames, etc. at the bottom of the video
-            if (written >= print_buffer_size - 1) {
+            if (written >= print_buffer_size - ANSI_MAX_CELL_BYTES) {
                 fprintf(stderr, "print buffer full at %d bytes\n", written);
                 break;
             }
-            // different formatting based on terminal width
-            if (curr_w >= 172) {
-                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                     "\x1B[%d;%dH\x1B[48;2;0;0;0;38;2;255;255;255m  fps: %6.2f  |  avg: %6.2f  |  decode: %6.1fms  |  render: %6.1fms  |  print: %6.1fms  |  cursor: %5d  |  chars: %6.1fk  |  dropped: %7lld  |  frame: %7lld   ",
-                                     msg_y + 1, 1,
-                                     static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
-                                     avg_fps,
-                                     static_cast<double>(decode_time) / 1000.0,
-                                     static_cast<double>(rendering_time) / 1000.0,
-                                     static_cast<double>(printing_time) / 1000.0,
-                                     cursor_moves, written / 1000.0, dropped, curr_frame);
-            } else if (curr_w >= 125) {
-                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                     "\x1B[%d;%dH\x1B[48;2;0;0;0;38;2;255;255;255m  fps: %6.2f  |  decode: %5.1fms  |  render: %5.1fms  |  print: %5.1fms  |  dropped: %7lld  |  frame: %7lld   ",
-                                     msg_y + 1, 1,
-                                     static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
-                                     static_cast<double>(decode_time) / 1000.0,
-                                     static_cast<double>(rendering_time) / 1000.0,
-                                     static_cast<double>(printing_time) / 1000.0,
-                                     dropped, curr_frame);
-            } else if (curr_w >= 88) {
-                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                     "\x1B[%d;%dH\x1B[48;2;0;0;0;38;2;255;255;255m  fps: %6.2f  |  d: %5.1f  r: %5.1f  p: %5.1f  |  frame: %7lld  drop: %5lld   ",
-                                     msg_y + 1, 1,
-                                     static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
-                                     static_cast<double>(decode_time) / 1000.0,
-                                     static_cast<double>(rendering_time) / 1000.0,
-                                     static_cast<double>(printing_time) / 1000.0,
-                                     curr_frame, dropped);
-            } else if (curr_w >= 56) {
-                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                     "\x1B[%d;%dH\x1B[48;2;0;0;0;38;2;255;255;255m  fps: %5.1f  |  frame: %7lld  |  dropped: %5lld   ",
-                                     msg_y + 1, 1,
-                                     static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
-                                     curr_frame, dropped);
-            } else if (curr_w >= 40) {
-                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                     "\x1B[%d;%dH\x1B[48;2;0;0;0;38;2;255;255;255m  fps: %5.1f  |  f: %7lld  d: %5lld ",
-                                     msg_y + 1, 1,
-                                     static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
-                                     curr_frame, dropped);
-            } else {
-                print_ret = snprintf(print_buf + written, print_buffer_size - written,
-                                     "\x1B[%d;%dH\x1B[48;2;0;0;0;38;2;255;255;255m  %5.1ffps  f:%lld ",
-                                     msg_y + 1, 1,
-                                     static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
-                                     curr_frame);
+            // the status line is left out while the terminal is being resized, its row may be gone
+            if (!clip_frame) {
+                // the status line colours are only set when the video changed them
+                ansi_emitter status(print_buf + written, curr_w);
+                status.set_sgr(sgr_bg, sgr_fg);
+                int sgr_len = status.restore(status_bg, status_fg);
+                sgr_saved += ansi_emitter::colors_length(status_bg, status_fg) - sgr_len;
+                written += sgr_len;
+                // different formatting based on terminal width
+                if (curr_w >= 196) {
+                    print_ret = snprintf(print_buf + written, print_buffer_size - written,
+                                         "\x1B[%d;%dH  fps: %6.2f  |  avg: %6.2f  |  decode: %6.1fms (q %2d/%-2d stall %5.1fms)  |  render: %6.1fms  |  print: %6.1fms  |  cursor: %5d  |  chars: %6.1fk  |  dropped: %7lld  |  frame: %7lld   ",
+                                         msg_y + 1, 1,
+                                         static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
+                                         avg_fps,
+                                         static_cast<double>(decode_time) / 1000.0,
+                                         frames.size(), frames.capacity(),
+                                         static_cast<double>(decode_stall_time) / 1000.0,
+                                         static_cast<double>(rendering_time) / 1000.0,
+                                         static_cast<double>(printing_time) / 1000.0,
+                                         cursor_moves, written / 1000.0, dropped, curr_frame);
+                } else if (curr_w >= 172) {
+                    print_ret = snprintf(print_buf + written, print_buffer_size - written,
+                                         "\x1B[%d;%dH  fps: %6.2f  |  avg: %6.2f  |  decode: %6.1fms  |  render: %6.1fms  |  print: %6.1fms  |  cursor: %5d  |  chars: %6.1fk  |  dropped: %7lld  |  frame: %7lld   ",
+                                         msg_y + 1, 1,
+                                         static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
+                                         avg_fps,
+                                         static_cast<double>(decode_time) / 1000.0,
+                                         static_cast<double>(rendering_time) / 1000.0,
+                                         static_cast<double>(printing_time) / 1000.0,
+                                         cursor_moves, written / 1000.0, dropped, curr_frame);
+                } else if (curr_w >= 125) {
+                    print_ret = snprintf(print_buf + written, print_buffer_size - written,
+                                         "\x1B[%d;%dH  fps: %6.2f  |  decode: %5.1fms  |  render: %5.1fms  |  print: %5.1fms  |  dropped: %7lld  |  frame: %7lld   ",
+                                         msg_y + 1, 1,
+                                         static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
+                                         static_cast<double>(decode_time) / 1000.0,
+                                         static_cast<double>(rendering_time) / 1000.0,
+                                         static_cast<double>(printing_time) / 1000.0,
+                                         dropped, curr_frame);
+                } else if (curr_w >= 88) {
+                    print_ret = snprintf(print_buf + written, print_buffer_size - written,
+                                         "\x1B[%d;%dH  fps: %6.2f  |  d: %5.1f  r: %5.1f  p: %5.1f  |  frame: %7lld  drop: %5lld   ",
+                                         msg_y + 1, 1,
+                                         static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
+                                         static_cast<double>(decode_time) / 1000.0,
+                                         static_cast<double>(rendering_time) / 1000.0,
+                                         static_cast<double>(printing_time) / 1000.0,
+                                         curr_frame, dropped);
+                } else if (curr_w >= 56) {
+                    print_ret = snprintf(print_buf + written, print_buffer_size - written,
+                                         "\x1B[%d;%dH  fps: %5.1f  |  frame: %7lld  |  dropped: %5lld   ",
+                                         msg_y + 1, 1,
+                                         static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
+                                         curr_frame, dropped);
+                } else if (curr_w >= 40) {
+                    print_ret = snprintf(print_buf + written, print_buffer_size - written,
+                                         "\x1B[%d;%dH  fps: %5.1f  |  f: %7lld  d: %5lld ",
+                                         msg_y + 1, 1,
+                                         static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
+                                         curr_frame, dropped);
+                } else {
+                    print_ret = snprintf(print_buf + written, print_buffer_size - written,
+                                         "\x1B[%d;%dH  %5.1ffps  f:%lld ",
+                                         msg_y + 1, 1,
+                                         static_cast<double>(frame_times.size()) * 1000000.0 / static_cast<double>(avg_frame_times_sum),
+                                         curr_frame);
+                }
+                if (print_ret > 0 && print_ret < print_buffer_size - written)
+                    written += print_ret;
+                for (int k = 0; k < 3; k++) {
+                    sgr_bg[k] = status_bg[k];
+                    sgr_fg[k] = status_fg[k];
+                }
             }
-            if (print_ret > 0 && print_ret < print_buffer_size - written)
-                written += print_ret;
+            rendered_sgr_saved += sgr_saved;
 
             // send buffer to printing thread
             {
@@ -1395,18 +1894,28 @@ int main(int argc, char *argv[]) {
             }
             buffer_ready_cv.notify_one();
 
+            if (time_to_first_frame < 0) {
+                time_to_first_frame = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - program_start).count();
+            }
+
             // get last printing time from write thread
             printing_time = last_printing_time.load();
             total_printing_time += printing_time;
         }
 
         // free the buffers when the video completes
-        if (alloc) {
-            std::free(frame);
-            std::free(old);
-            std::free(print_buf);
-            std::free(error_buffer);
+        {
+            std::lock_guard<std::mutex> lock(render_buffer_mutex);
+            render_buffer = nullptr;
+            render_buffer_written = 0;
+            frame_ready = false;
+            delete arena;
+            arena = nullptr;
         }
+
+        // the queue is destroyed with this scope, its totals are already in the globals
+        decode_queue = nullptr;
     } else {
         printf("\x1B[0mfile not found\n");
         fflush(stdout);
@@ -2,10 +2,13 @@
 
 #include "opencl_proc.h"
 #include "generated/kernel_source.h"
+#include "pixelmap.h"
 #include <iostream>
 #include <cmath>
 #define CHANGE_THRESHOLD 15
 #define DITHERING_DECAY 0.7f
+// bytes per cell of the device side screen state, matches screen_cell
+#define SCREEN_CELL_SIZE 8
 
 OpenCLProc::OpenCLProc() {
 }
@@ -16,14 +19,12 @@ OpenCLProc::~OpenCLProc() {
 
 void OpenCLProc::cleanup() const {
     if (d_frame) clReleaseMemObject(d_frame);
-    if (d_old_frame) clReleaseMemObject(d_old_frame);
-    if (d_output_frame) clReleaseMemObject(d_output_frame);
+    if (d_screen) clReleaseMemObject(d_screen);
     if (d_error_buffer) clReleaseMemObject(d_error_buffer);
     if (d_char_indices) clReleaseMemObject(d_char_indices);
     if (d_fg_colors) clReleaseMemObject(d_fg_colors);
     if (d_bg_colors) clReleaseMemObject(d_bg_colors);
     if (d_needs_update) clReleaseMemObject(d_needs_update);
-    if (d_pixelmap) clReleaseMemObject(d_pixelmap);
     if (kernel_process) clReleaseKernel(kernel_process);
     if (program) clReleaseProgram(program);
     if (queue) clReleaseCommandQueue(queue);
@@ -35,7 +36,6 @@ std::string OpenCLProc::getKernelSource() {
 }
 
 bool OpenCLProc::initialize() {
-#include "pixelmap.h"  // Include to access the pixelmap data
     cl_int err;
     cl_platform_id platform;
 
@@ -92,11 +92,19 @@ bool OpenCLProc::initialize() {
     const int char_x = CHAR_X;
     const int diff_cases = DIFF_CASES;
 
+    // the glyph set goes into the program as constants, 8 bytes per glyph
+    std::string glyph_table = "__constant ulong glyph_masks[DIFF_CASES] = {";
+    for (uint64_t mask: glyph_masks) glyph_table += std::to_string(mask) + "UL, ";
+    glyph_table += "};\n__constant int glyph_fg_count[DIFF_CASES] = {";
+    for (int count: glyph_fg_count) glyph_table += std::to_string(count) + ", ";
+    glyph_table += "};\n\n";
+
     // Create kernel source with injected constants
     std::string kernel_src =
             "#define CHAR_Y " + std::to_string(char_y) + "\n"
             "#define CHAR_X " + std::to_string(char_x) + "\n"
             "#define DIFF_CASES " + std::to_string(diff_cases) + "\n\n"
+            + glyph_table
             + getKernelSource();
 
     const char *src_ptr = kernel_src.c_str();
@@ -125,25 +133,6 @@ bool OpenCLProc::initialize() {
         return false;
     }
 
-    // Create and upload pixelmap buffer
-    // flatten 2D array
-    std::vector<int> flat_pixelmap(DIFF_CASES * CHAR_Y * CHAR_X);
-    for (int i = 0; i < DIFF_CASES; i++) {
-        for (int j = 0; j < CHAR_Y * CHAR_X; j++) {
-            flat_pixelmap[i * CHAR_Y * CHAR_X + j] = pixelmap[i][j];
-        }
-    }
-
-    // Create buffer and copy data
-    d_pixelmap = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-                                flat_pixelmap.size() * sizeof(int),
-                                flat_pixelmap.data(), &err);
-    if (err != CL_SUCCESS) {
-        std::cerr << "Failed to create pixelmap buffer" << std::endl;
-        return false;
-    }
-
-
     initialized = true;
     return true;
 }
@@ -155,16 +144,14 @@ bool OpenCLProc::createBuffers(size_t frame_size, size_t grid_size) {
 
     // Release old buffers
     if (d_frame) clReleaseMemObject(d_frame);
-    if (d_old_frame) clReleaseMemObject(d_old_frame);
-    if (d_output_frame) clReleaseMemObject(d_output_frame);
+    if (d_screen) clReleaseMemObject(d_screen);
     if (d_error_buffer) clReleaseMemObject(d_error_buffer);
     if (d_char_indices) clReleaseMemObject(d_char_indices);
     if (d_fg_colors) clReleaseMemObject(d_fg_colors);
     if (d_bg_colors) clReleaseMemObject(d_bg_colors);
     if (d_needs_update) clReleaseMemObject(d_needs_update);
     d_frame = nullptr;
-    d_old_frame = nullptr;
-    d_output_frame = nullptr;
+    d_screen = nullptr;
     d_error_buffer = nullptr;
     d_char_indices = nullptr;
     d_fg_colors = nullptr;
@@ -175,10 +162,8 @@ bool OpenCLProc::createBuffers(size_t frame_size, size_t grid_size) {
     d_frame = clCreateBuffer(context, CL_MEM_READ_ONLY, frame_size, nullptr, &err);
     if (err != CL_SUCCESS) return false;
 
-    d_old_frame = clCreateBuffer(context, CL_MEM_READ_ONLY, frame_size, nullptr, &err);
-    if (err != CL_SUCCESS) return false;
-
-    d_output_frame = clCreateBuffer(context, CL_MEM_WRITE_ONLY, frame_size, nullptr, &err);
+    // glyph, fg and bg of every cell on screen, only ever read and written by the kernel
+    d_screen = clCreateBuffer(context, CL_MEM_READ_WRITE, grid_size * SCREEN_CELL_SIZE, nullptr, &err);
     if (err != CL_SUCCESS) return false;
 
     d_error_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE,
@@ -207,6 +192,12 @@ bool OpenCLProc::createBuffers(size_t frame_size, size_t grid_size) {
                                0, nullptr, nullptr);
     if (err != CL_SUCCESS) return false;
 
+    std::vector<unsigned char> zero_screen(grid_size * SCREEN_CELL_SIZE, 0);
+    err = clEnqueueWriteBuffer(queue, d_screen, CL_TRUE, 0,
+                               zero_screen.size(), zero_screen.data(),
+                               0, nullptr, nullptr);
+    if (err != CL_SUCCESS) return false;
+
     current_buffer_size = frame_size;
     current_grid_size = grid_size;
     return true;
@@ -214,8 +205,6 @@ bool OpenCLProc::createBuffers(size_t frame_size, size_t grid_size) {
 
 void OpenCLProc::processFrame(
     const char *frame,
-    const char *old_frame,
-    char *output_frame,
     int width,
     int height,
     int char_width,
@@ -226,11 +215,14 @@ void OpenCLProc::processFrame(
     int *char_indices,
     int *fg_colors,
     int *bg_colors,
-    bool *needs_update
+    bool *needs_update,
+    int cell_w,
+    int cell_h,
+    int stride
 ) {
     if (!initialized) return;
 
-    size_t frame_size = width * height * 3;
+    size_t frame_size = (size_t) stride * height;
     size_t grid_size = char_width * char_height;
 
     if (!createBuffers(frame_size, grid_size)) {
@@ -240,11 +232,9 @@ void OpenCLProc::processFrame(
 
     cl_int err;
 
-    // Upload data to GPU
+    // Upload data to GPU, the screen state is already there
     err = clEnqueueWriteBuffer(queue, d_frame, CL_FALSE, 0, frame_size,
                                frame, 0, nullptr, nullptr);
-    err |= clEnqueueWriteBuffer(queue, d_old_frame, CL_FALSE, 0, frame_size,
-                                old_frame, 0, nullptr, nullptr);
 
     if (err != CL_SUCCESS) {
         std::cerr << "Failed to upload data to GPU" << std::endl;
@@ -255,21 +245,22 @@ void OpenCLProc::processFrame(
     int refresh_int = refresh ? 1 : 0;
     int dither_int = dither ? 1 : 0;  // Add this line
     clSetKernelArg(kernel_process, 0, sizeof(cl_mem), &d_frame);
-    clSetKernelArg(kernel_process, 1, sizeof(cl_mem), &d_old_frame);
-    clSetKernelArg(kernel_process, 2, sizeof(cl_mem), &d_output_frame);
-    clSetKernelArg(kernel_process, 3, sizeof(cl_mem), &d_error_buffer);
-    clSetKernelArg(kernel_process, 4, sizeof(cl_mem), &d_char_indices);
-    clSetKernelArg(kernel_process, 5, sizeof(cl_mem), &d_fg_colors);
-    clSetKernelArg(kernel_process, 6, sizeof(cl_mem), &d_bg_colors);
-    clSetKernelArg(kernel_process, 7, sizeof(cl_mem), &d_needs_update);
-    clSetKernelArg(kernel_process, 8, sizeof(int), &width);
-    clSetKernelArg(kernel_process, 9, sizeof(int), &height);
-    clSetKernelArg(kernel_process, 10, sizeof(int), &char_width);
-    clSetKernelArg(kernel_process, 11, sizeof(int), &char_height);
-    clSetKernelArg(kernel_process, 12, sizeof(int), &diffthreshold);
-    clSetKernelArg(kernel_process, 13, sizeof(int), &refresh_int);
-    clSetKernelArg(kernel_process, 14, sizeof(int), &dither_int);
-    clSetKernelArg(kernel_process, 15, sizeof(cl_mem), &d_pixelmap);
+    clSetKernelArg(kernel_process, 1, sizeof(cl_mem), &d_screen);
+    clSetKernelArg(kernel_process, 2, sizeof(cl_mem), &d_error_buffer);
+    clSetKernelArg(kernel_process, 3, sizeof(cl_mem), &d_char_indices);
+    clSetKernelArg(kernel_process, 4, sizeof(cl_mem), &d_fg_colors);
+    clSetKernelArg(kernel_process, 5, sizeof(cl_mem), &d_bg_colors);
+    clSetKernelArg(kernel_process, 6, sizeof(cl_mem), &d_needs_update);
+    clSetKernelArg(kernel_process, 7, sizeof(int), &width);
+    clSetKernelArg(kernel_process, 8, sizeof(int), &height);
+    clSetKernelArg(kernel_process, 9, sizeof(int), &char_width);
+    clSetKernelArg(kernel_process, 10, sizeof(int), &char_height);
+    clSetKernelArg(kernel_process, 11, sizeof(int), &diffthreshold);
+    clSetKernelArg(kernel_process, 12, sizeof(int), &refresh_int);
+    clSetKernelArg(kernel_process, 13, sizeof(int), &dither_int);
+    clSetKernelArg(kernel_process, 14, sizeof(int), &cell_w);
+    clSetKernelArg(kernel_process, 15, sizeof(int), &cell_h);
+    clSetKernelArg(kernel_process, 16, sizeof(int), &stride);
 
     // Execute kernel
     size_t global_work_size[2] = {(size_t) char_width, (size_t) char_height};
@@ -281,10 +272,8 @@ void OpenCLProc::processFrame(
         return;
     }
 
-    // Download results
-    err = clEnqueueReadBuffer(queue, d_output_frame, CL_FALSE, 0, frame_size,
-                              output_frame, 0, nullptr, nullptr);
-    err |= clEnqueueReadBuffer(queue, d_char_indices, CL_FALSE, 0,
+    // Download results, the screen state stays on the device
+    err = clEnqueueReadBuffer(queue, d_char_indices, CL_FALSE, 0,
                                grid_size * sizeof(int),
                                char_indices, 0, nullptr, nullptr);
     err |= clEnqueueReadBuffer(queue, d_fg_colors, CL_FALSE, 0,
@@ -0,0 +1,84 @@
+#include "packet_queue.h"
+
+packet_queue::~packet_queue() {
+    for (AVPacket *pkt: packets) av_packet_free(&pkt);
+}
+
+bool packet_queue::put(AVPacket *pkt) {
+    AVPacket *queued = av_packet_alloc();
+    if (!queued) {
+        av_packet_unref(pkt);
+        return false;
+    }
+    av_packet_move_ref(queued, pkt);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        packets.push_back(queued);
+        total_bytes += queued->size;
+        total_duration += queued->duration;
+    }
+    not_empty.notify_one();
+    return true;
+}
+
+void packet_queue::put_eof() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        eof = true;
+    }
+    not_empty.notify_all();
+}
+
+int packet_queue::get(AVPacket *pkt) {
+    AVPacket *queued;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return aborted || eof || !packets.empty(); });
+        if (aborted) return -1;
+        if (packets.empty()) return 0;
+
+        queued = packets.front();
+        packets.pop_front();
+        total_bytes -= queued->size;
+        total_duration -= queued->duration;
+    }
+    signal_space();
+    av_packet_move_ref(pkt, queued);
+    av_packet_free(&queued);
+    return 1;
+}
+
+void packet_queue::abort() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+    }
+    not_empty.notify_all();
+    signal_space();
+}
+
+void packet_queue::set_space(packet_space *s) {
+    space = s;
+}
+
+void packet_queue::signal_space() {
+    if (!space) return;
+    // taking the lock orders the change before a waiter's next check, so the wakeup is not lost
+    {
+        std::lock_guard<std::mutex> lock(space->mutex);
+    }
+    space->freed.notify_all();
+}
+
+bool packet_queue::is_enough(AVRational time_base) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // a stream which has ended has all the packets it will ever get
+    if (eof || aborted) return true;
+    return packets.size() > PACKET_QUEUE_MIN_PACKETS
+           && (total_duration == 0 || total_duration * av_q2d(time_base) > PACKET_QUEUE_MIN_DURATION);
+}
+
+long long packet_queue::bytes() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return total_bytes;
+}
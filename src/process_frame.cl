@@ -1,3 +1,7 @@
+// glyph_masks and glyph_fg_count are injected ahead of this source from pixelmap.h,
+// bit i * CHAR_X + j of a glyph's mask is set for its foreground pixels
+#define GLYPH_IS_FG(g, p) ((glyph_masks[g] >> (p)) & 1)
+
 float srgb_to_linear(uchar c) {
     float v = c / 255.0f;
     if (v <= 0.04045f)
@@ -65,8 +69,7 @@ void atomic_add_float(__global float* addr, float val) {
 
 __kernel void process_characters(
     __global const uchar* frame,
-    __global const uchar* old_frame,
-    __global uchar* output_frame,
+    __global uchar* screen,
     __global float* error_buffer,
     __global int* char_indices,
     __global int* fg_colors,
@@ -79,7 +82,9 @@ __kernel void process_characters(
     int diff_threshold,
     int refresh,
     int dither_enable,
-    __global const int* pixelmap
+    int cell_width,
+    int cell_height,
+    int frame_stride
 ) {
     int x = get_global_id(0);
     int y = get_global_id(1);
@@ -87,21 +92,23 @@ __kernel void process_characters(
     if (x >= grid_width || y >= grid_height) return;
 
     int char_idx = y * grid_width + x;
-    int sx = CHAR_X;
-    int sy = CHAR_X * 2;
+    int sx = cell_width;
+    int sy = cell_height;
     int skipy = sy / CHAR_Y;
     int skipx = sx / CHAR_X;
 
     // convert all pixels to linear space for the
     // subsequent pixel processing
     float pixel_linear[CHAR_Y][CHAR_X][3];
-    float old_pixel_linear[CHAR_Y][CHAR_X][3];
+
+    // what the cell shows, glyph then fg and bg in bgr order, 8 bytes per cell
+    __global uchar* cell = screen + char_idx * 8;
 
     for (int i = 0; i < CHAR_Y; i++) {
         for (int j = 0; j < CHAR_X; j++) {
             int px = x * sx + j * skipx;
             int py = y * sy + i * skipy;
-            int pix_idx = (py * frame_width + px) * 3;
+            int pix_idx = py * frame_stride + px * 3;
 
             // Apply accumulated error from previous frame
             // convert to linear space (BGR ordering)
@@ -115,12 +122,6 @@ __kernel void process_characters(
                 pixel_linear[i][j][1] = srgb_to_linear(frame[pix_idx + 1]); // G
                 pixel_linear[i][j][2] = srgb_to_linear(frame[pix_idx + 0]); // B
             }
-
-            if (!refresh) {
-                old_pixel_linear[i][j][0] = srgb_to_linear(old_frame[pix_idx + 2]);
-                old_pixel_linear[i][j][1] = srgb_to_linear(old_frame[pix_idx + 1]);
-                old_pixel_linear[i][j][2] = srgb_to_linear(old_frame[pix_idx + 0]);
-            }
         }
     }
 
@@ -135,10 +136,19 @@ __kernel void process_characters(
     if (refresh) {
         max_diff = 9999.0f;
     } else {
+        // the on screen pixels are the glyph mask expanded with the cell's two colours
+        int old_glyph = cell[0];
+        float old_fg[3], old_bg[3];
+        for (int k = 0; k < 3; k++) {
+            old_fg[k] = srgb_to_linear(cell[3 - k]);
+            old_bg[k] = srgb_to_linear(cell[6 - k]);
+        }
+
         for (int i = 0; i < CHAR_Y; i++) {
             for (int j = 0; j < CHAR_X; j++) {
+                float* old_px = GLYPH_IS_FG(old_glyph, i * CHAR_X + j) ? old_fg : old_bg;
                 float d = perceptual_diff_linear(
-                    old_pixel_linear[i][j][0], old_pixel_linear[i][j][1], old_pixel_linear[i][j][2],
+                    old_px[0], old_px[1], old_px[2],
                     pixel_linear[i][j][0], pixel_linear[i][j][1], pixel_linear[i][j][2]
                 );
                 max_diff = max(max_diff, d);
@@ -159,20 +169,15 @@ __kernel void process_characters(
             // calculate average colors
             float linear_fg[3] = {0.0f, 0.0f, 0.0f};
             float linear_bg[3] = {0.0f, 0.0f, 0.0f};
-            int bg_count = 0, fg_count = 0;
+            ulong mask = glyph_masks[case_it];
+            int fg_count = glyph_fg_count[case_it];
+            int bg_count = CHAR_Y * CHAR_X - fg_count;
 
             for (int i = 0; i < CHAR_Y; i++) {
                 for (int j = 0; j < CHAR_X; j++) {
-                    int pmap_idx = case_it * CHAR_Y * CHAR_X + i * CHAR_X + j;
-                    if (pixelmap[pmap_idx]) {
-                        for (int k = 0; k < 3; k++)
-                            linear_fg[k] += pixel_linear[i][j][k];
-                        fg_count++;
-                    } else {
-                        for (int k = 0; k < 3; k++)
-                            linear_bg[k] += pixel_linear[i][j][k];
-                        bg_count++;
-                    }
+                    float* sum = (mask >> (i * CHAR_X + j)) & 1 ? linear_fg : linear_bg;
+                    for (int k = 0; k < 3; k++)
+                        sum[k] += pixel_linear[i][j][k];
                 }
             }
 
@@ -186,8 +191,7 @@ __kernel void process_characters(
             float mse = 0.0f;
             for (int i = 0; i < CHAR_Y; i++) {
                 for (int j = 0; j < CHAR_X; j++) {
-                    int pmap_idx = case_it * CHAR_Y * CHAR_X + i * CHAR_X + j;
-                    float* target = pixelmap[pmap_idx] ? linear_fg : linear_bg;
+                    float* target = (mask >> (i * CHAR_X + j)) & 1 ? linear_fg : linear_bg;
                     for (int k = 0; k < 3; k++) {
                         float diff = pixel_linear[i][j][k] - target[k];
                         mse += diff * diff;
@@ -212,20 +216,14 @@ __kernel void process_characters(
         // calculate final average colors in linear space
         float linear_fg[3] = {0.0f, 0.0f, 0.0f};
         float linear_bg[3] = {0.0f, 0.0f, 0.0f};
-        int bg_count = 0, fg_count = 0;
+        int fg_count = glyph_fg_count[case_min];
+        int bg_count = CHAR_Y * CHAR_X - fg_count;
 
         for (int i = 0; i < CHAR_Y; i++) {
             for (int j = 0; j < CHAR_X; j++) {
-                int pmap_idx = case_min * CHAR_Y * CHAR_X + i * CHAR_X + j;
-                if (pixelmap[pmap_idx]) {
-                    for (int k = 0; k < 3; k++)
-                        linear_fg[k] += pixel_linear[i][j][k];
-                    fg_count++;
-                } else {
-                    for (int k = 0; k < 3; k++)
-                        linear_bg[k] += pixel_linear[i][j][k];
-                    bg_count++;
-                }
+                float* sum = GLYPH_IS_FG(case_min, i * CHAR_X + j) ? linear_fg : linear_bg;
+                for (int k = 0; k < 3; k++)
+                    sum[k] += pixel_linear[i][j][k];
             }
         }
 
@@ -244,8 +242,7 @@ __kernel void process_characters(
                 // calculate average error across all pixels in this character
                 for (int i = 0; i < CHAR_Y; i++) {
                     for (int j = 0; j < CHAR_X; j++) {
-                        int pmap_idx = case_min * CHAR_Y * CHAR_X + i * CHAR_X + j;
-                        int target = pixelmap[pmap_idx] ? pixelchar[k] : pixelbg[k];
+                        int target = GLYPH_IS_FG(case_min, i * CHAR_X + j) ? pixelchar[k] : pixelbg[k];
                         float pixel_srgb = linear_to_srgb(pixel_linear[i][j][k]);
                         total_error += (pixel_srgb - (float)target);
                     }
@@ -299,34 +296,11 @@ __kernel void process_characters(
         fg_colors[char_idx] = (pixelchar[0] << 16) | (pixelchar[1] << 8) | pixelchar[2];
         bg_colors[char_idx] = (pixelbg[0] << 16) | (pixelbg[1] << 8) | pixelbg[2];
 
-        // update output frame
-        // convert averaged linear values back to sRGB
-        for (int i = 0; i < CHAR_Y; i++) {
-            for (int j = 0; j < CHAR_X; j++) {
-                int px = x * sx + j * skipx;
-                int py = y * sy + i * skipy;
-                int pix_idx = (py * frame_width + px) * 3;
-                int pmap_idx = case_min * CHAR_Y * CHAR_X + i * CHAR_X + j;
-
-                // Output in BGR order
-                output_frame[pix_idx + 2] = pixelmap[pmap_idx] ? pixelchar[0] : pixelbg[0]; // R
-                output_frame[pix_idx + 1] = pixelmap[pmap_idx] ? pixelchar[1] : pixelbg[1]; // G
-                output_frame[pix_idx + 0] = pixelmap[pmap_idx] ? pixelchar[2] : pixelbg[2]; // B
-            }
-        }
-    } else {
-        // write old data to output frame
-        for (int i = 0; i < CHAR_Y; i++) {
-            for (int j = 0; j < CHAR_X; j++) {
-                int px = x * sx + j * skipx;
-                int py = y * sy + i * skipy;
-                int pix_idx = (py * frame_width + px) * 3;
-
-                // Output in BGR order
-                output_frame[pix_idx + 2] = old_frame[pix_idx + 2]; // R
-                output_frame[pix_idx + 1] = old_frame[pix_idx + 1]; // G
-                output_frame[pix_idx + 0] = old_frame[pix_idx + 0]; // B
-            }
+        // remember what the cell now shows, in BGR order
+        cell[0] = (uchar)case_min;
+        for (int k = 0; k < 3; k++) {
+            cell[1 + k] = (uchar)pixelchar[2 - k];
+            cell[4 + k] = (uchar)pixelbg[2 - k];
         }
     }
 }
\ No newline at end of file
@@ -4,34 +4,48 @@
 
 #include "video.h"
 
-#include <mutex>
-#include <queue>
-
-struct AudioBuffer {
-    std::queue<std::vector<uint8_t> > queue;
-    std::mutex mutex;
-    size_t max_size = 30; // around 0.5 seconds of audio buffered
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "audio_ring.h"
+
+static audio_ring audio_buffer;
+
+// the audio clock counts the bytes the callback has handed to the device, starting from the
+// timestamp of the first sample that went into the ring. audio which had to be dropped because
+// the ring was full is added to the skipped time, so the clock stays on the media timeline
+struct audio_clock_state {
+    double start_pts = 0;
+    std::atomic<double> skipped{0};
+    std::atomic<bool> started{false};
+    uint64_t consumed = 0;
+    // clock at the last callback that got samples, and when that callback ran
+    std::atomic<double> at_callback{0};
+    std::atomic<long long> callback_time{0};
+    double bytes_per_sec = 0;
+    // duration of one device buffer, the one just filled plays after the one that is playing
+    double chunk = 0;
 };
 
-static AudioBuffer audio_buffer;
-
-// sdl audio callback
-void audio_callback([[maybe_unused]] void *userdata, uint8_t *stream, int len) {
-    std::lock_guard<std::mutex> lock(audio_buffer.mutex);
-
-    int bytes_written = 0;
-    while (bytes_written < len && !audio_buffer.queue.empty()) {
-        auto &front = audio_buffer.queue.front();
-        int to_copy = std::min((int) front.size(), len - bytes_written);
+static audio_clock_state audio_clock;
 
-        memcpy(stream + bytes_written, front.data(), to_copy);
-        bytes_written += to_copy;
+static long long steady_now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-        if (to_copy == (int) front.size()) {
-            audio_buffer.queue.pop();
-        } else {
-            front.erase(front.begin(), front.begin() + to_copy);
-        }
+// sdl audio callback, runs on the real-time audio thread so it must not block
+void audio_callback([[maybe_unused]] void *userdata, uint8_t *stream, int len) {
+    int bytes_written = static_cast<int>(audio_buffer.read(stream, len));
+
+    if (bytes_written > 0) {
+        audio_clock.consumed += bytes_written;
+        audio_clock.at_callback.store(audio_clock.start_pts + audio_clock.skipped.load()
+                                      + (double) audio_clock.consumed / audio_clock.bytes_per_sec
+                                      - 2.0 * audio_clock.chunk);
+        audio_clock.callback_time.store(steady_now_us());
     }
 
     // Fill remaining with silence
@@ -40,7 +54,16 @@ void audio_callback([[maybe_unused]] void *userdata, uint8_t *stream, int len) {
     }
 }
 
-video::video(const char filename[], int w, int h, bool enable_audio) {
+// pick a decoder quality level from the fraction of the source resolution that is shown
+static int pick_decode_quality(double shown) {
+    if (shown >= 0.5) return 0;
+    if (shown >= 0.25) return 1;
+    if (shown >= 0.125) return 2;
+    return 3;
+}
+
+video::video(const char filename[], int w, int h, const video_options &opts) {
+    bool enable_audio = opts.enable_audio;
     errbuf[0] = '\0';
     av_log_set_level(AV_LOG_ERROR);
 
@@ -49,12 +72,29 @@ video::video(const char filename[], int w, int h, bool enable_audio) {
     const char *input_name = is_pipe ? "pipe:0" : filename;
 
     AVDictionary *options = nullptr;
-    if (is_pipe) {
+    if (opts.fast_start) {
+        // probe just enough to find the streams, the rest is learned while decoding
+        av_dict_set(&options, "analyzeduration", FAST_START_ANALYZEDURATION, 0);
+        av_dict_set(&options, "probesize", FAST_START_PROBESIZE, 0);
+    } else if (is_pipe) {
         // set options for pipe handling
         av_dict_set(&options, "analyzeduration", "10000000", 0);  // 10 seconds
         av_dict_set(&options, "probesize", "10000000", 0);         // 10MB
     }
 
+    // read through our own io layer where possible, otherwise avformat opens the input itself
+    io = new avio_source(input_name, is_pipe);
+    if (io->is_opened()) {
+        inctx = avformat_alloc_context();
+        if (inctx) {
+            inctx->pb = io->get_context();
+            inctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+    } else {
+        delete io;
+        io = nullptr;
+    }
+
     int ret = avformat_open_input(&inctx, input_name, nullptr, &options);
     if (options) av_dict_free(&options);
 
@@ -87,6 +127,54 @@ video::video(const char filename[], int w, int h, bool enable_audio) {
         return;
     }
 
+    // choose decoder shortcuts, the terminal cannot show detail beyond the output size
+    decode_quality_auto = opts.decode_quality == DECODE_QUALITY_AUTO;
+    int level = 0;
+    int fit_w = codec->width, fit_h = codec->height;
+    if (opts.target_width > 0 && opts.target_height > 0 && codec->width > 0 && codec->height > 0) {
+        double scale = std::min((double) opts.target_width / codec->width,
+                                (double) opts.target_height / codec->height);
+        fit_w = (int) (codec->width * scale);
+        fit_h = (int) (codec->height * scale);
+        if (decode_quality_auto) level = pick_decode_quality(scale);
+    }
+    if (!decode_quality_auto) level = std::clamp(opts.decode_quality, 0, DECODE_QUALITY_MAX);
+
+    // lowres has to be chosen before the codec is opened, only reduce as far as
+    // the decoded picture still covers the output size
+    if (level >= 3) {
+        int lowres = 0;
+        while (lowres < vcodec->max_lowres
+               && (codec->width >> (lowres + 1)) >= fit_w
+               && (codec->height >> (lowres + 1)) >= fit_h) {
+            lowres++;
+        }
+        codec->lowres = lowres;
+    }
+    apply_decode_quality(level);
+
+    // leave a core each for the render and print threads, up to the 16 threads libavcodec
+    // is tuned for. every frame thread adds a frame of latency and its own frame buffers
+    int threads = opts.decode_threads;
+    if (threads <= 0) {
+        int cores = (int) std::thread::hardware_concurrency();
+        threads = cores > 0 ? std::clamp(cores - 2, 1, DECODE_THREADS_MAX) : 0;
+    }
+    codec->thread_count = threads;
+    codec->thread_type = opts.decode_thread_type == DECODE_THREAD_TYPE_AUTO
+                             ? FF_THREAD_FRAME | FF_THREAD_SLICE
+                             : opts.decode_thread_type;
+
+    // scaling runs on the decode thread between frames, so it gets a smaller share of the cores
+    scale_threads = opts.scale_threads;
+    if (scale_threads <= 0) {
+        int cores = (int) std::thread::hardware_concurrency();
+        scale_threads = std::clamp(cores / 2, 1, 8);
+    }
+#if !SWS_HAS_THREADS
+    scale_threads = 1;
+#endif
+
     ret = avcodec_open2(codec, vcodec, nullptr);
     if (ret < 0) {
         av_make_error_string(errbuf, sizeof(errbuf), ret);
@@ -94,22 +182,7 @@ video::video(const char filename[], int w, int h, bool enable_audio) {
         return;
     }
 
-    src_width = codec->width;
-    src_height = codec->height;
-
-    if (w == -1 || h == -1) {
-        dst_width = src_width;
-        dst_height = src_height;
-    } else {
-        dst_width = w;
-        dst_height = h;
-    }
-
-    frame = av_frame_alloc();
-    decframe = av_frame_alloc();
-    pkt = av_packet_alloc();
-
-    setResize(dst_width, dst_height);
+    if (inctx->start_time != AV_NOPTS_VALUE) stream_start = (double) inctx->start_time / AV_TIME_BASE;
 
     // attempt to find audio stream if audio enabled
     if (enable_audio) {
@@ -177,7 +250,22 @@ video::video(const char filename[], int w, int h, bool enable_audio) {
                                     swr_free(&swr_ctx);
                                 } else {
                                     swr_set_compensation(swr_ctx, 0, 0);
-                                    SDL_PauseAudio(0); // start playing
+                                    // the ring holds a fixed amount of time worth of output samples
+                                    int frame_bytes = audio_codec->ch_layout.nb_channels * 2;
+                                    size_t ring_bytes = (size_t) spec.freq * frame_bytes * AUDIO_RING_MS / 1000;
+                                    if (!audio_buffer.allocate(ring_bytes, frame_bytes)) {
+                                        fprintf(stderr, "failed to allocate audio buffer\n");
+                                        audio_available = false;
+                                        SDL_CloseAudio();
+                                        swr_free(&swr_ctx);
+                                    } else {
+                                        audio_clock.started.store(false);
+                                        audio_clock.skipped.store(0);
+                                        audio_clock.consumed = 0;
+                                        audio_clock.callback_time.store(0);
+                                        audio_clock.bytes_per_sec = (double) spec.freq * frame_bytes;
+                                        audio_clock.chunk = (double) spec.samples / spec.freq;
+                                    }
                                 }
                             }
                         }
@@ -187,11 +275,62 @@ video::video(const char filename[], int w, int h, bool enable_audio) {
         }
     }
 
+    // streams nobody decodes are dropped by the demuxer before they are even queued
+    for (unsigned i = 0; i < inctx->nb_streams; i++) {
+        if ((int) i != vstrm_idx && !(audio_available && (int) i == astrm_idx))
+            inctx->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    // from here on packets come from the demux thread, audio is decoded on its own thread
+    frame = av_frame_alloc();
+    decframe = av_frame_alloc();
+    pkt = av_packet_alloc();
+    demux_pkt = av_packet_alloc();
+    if (!frame || !decframe || !pkt || !demux_pkt) return;
+    threads_running = true;
+    video_packets.set_space(&queue_space);
+    audio_packets.set_space(&queue_space);
+    demux_thread = std::thread(&video::demux_loop, this);
+    if (audio_available) audio_thread = std::thread(&video::audio_loop, this);
+
+    // a short probe may not have reached a decodable frame yet
+    if ((codec->width <= 0 || codec->height <= 0) && !decode_first_frame()) {
+        fprintf(stderr, "fail to find the video frame size\n");
+        return;
+    }
+
+    src_width = codec->width;
+    src_height = codec->height;
+
+    // planar output keeps the source chroma layout, anything other than 4:4:4 is
+    // brought to 4:2:0 so the renderer only has to handle two layouts
+    if (opts.planar_yuv) {
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(codec->pix_fmt);
+        bool full_chroma = desc && !(desc->flags & AV_PIX_FMT_FLAG_RGB)
+                           && desc->log2_chroma_w == 0 && desc->log2_chroma_h == 0 && desc->nb_components >= 3;
+        dst_pix_fmt = full_chroma ? AV_PIX_FMT_YUV444P : AV_PIX_FMT_YUV420P;
+    }
+
+    if (w == -1 || h == -1) {
+        dst_width = src_width;
+        dst_height = src_height;
+    } else {
+        dst_width = w;
+        dst_height = h;
+    }
+
+    setResize(dst_width, dst_height);
+
     opened = true;
 }
 
 double video::get_fps() const {
-    return av_q2d(vstrm->r_frame_rate);
+    // a short probe can leave the frame rate unset, so fall back through the other estimates
+    const AVRational rates[] = {vstrm->r_frame_rate, vstrm->avg_frame_rate, codec->framerate};
+    for (const AVRational &rate: rates) {
+        if (rate.num > 0 && rate.den > 0) return av_q2d(rate);
+    }
+    return FALLBACK_FPS;
 }
 
 int video::get_width() const {
@@ -214,88 +353,171 @@ int video::get_audio_channels() const {
     return audio_available ? audio_codec->ch_layout.nb_channels : 0;
 }
 
-int video::get_frame(int dst_w, int dst_h, const char *dst_frame) {
-    int ret;
-    bool got_video_frame = false;
+int video::demux_packet() {
+    int ret = video_packets.get(pkt);
+    if (ret < 0) return -1;
+    end_of_stream_pkt = ret == 0;
+    if (end_of_stream_pkt) {
+        avcodec_send_packet(codec, nullptr);
+        return 0;
+    }
 
-    if (dst_w != dst_width || dst_h != dst_height) return 1;
+    ret = avcodec_send_packet(codec, pkt);
+    if (ret < 0) {
+        av_make_error_string(errbuf, sizeof(errbuf), ret);
+        fprintf(stderr, "fail to av_send_packet: %s\n", errbuf);
+    }
+    av_packet_unref(pkt);
+    return 1;
+}
 
-    do {
-        if (!end_of_stream_pkt) {
-            ret = av_read_frame(inctx, pkt);
-            end_of_stream_pkt = (AVERROR_EOF == ret);
-            if (end_of_stream_pkt) {
-                avcodec_send_packet(codec, nullptr);
-                if (audio_available) avcodec_send_packet(audio_codec, nullptr);
+void video::demux_loop() {
+    // every stream has enough queued or the queues got too big
+    auto queues_full = [this] {
+        bool audio_enough = !audio_available || audio_packets.is_enough(astrm->time_base);
+        return video_packets.bytes() + audio_packets.bytes() > PACKET_QUEUES_MAX_BYTES
+               || (video_packets.is_enough(vstrm->time_base) && audio_enough);
+    };
+
+    while (threads_running.load()) {
+        // stop reading ahead until the decoders have drained the queues
+        {
+            std::unique_lock<std::mutex> lock(queue_space.mutex);
+            queue_space.freed.wait(lock, [&] { return !threads_running.load() || !queues_full(); });
+        }
+        if (!threads_running.load()) break;
+
+        int ret = av_read_frame(inctx, demux_pkt);
+        if (ret < 0) {
+            if (ret != AVERROR_EOF) {
+                char read_errbuf[200];
+                av_make_error_string(read_errbuf, sizeof(read_errbuf), ret);
+                fprintf(stderr, "fail to av_read_frame: %s\n", read_errbuf);
             }
-            if (ret < 0 && ret != AVERROR_EOF) {
-                av_make_error_string(errbuf, sizeof(errbuf), ret);
-                fprintf(stderr, "fail to av_read_frame: %s\n", errbuf);
-                av_packet_unref(pkt);
-                return -1;
+            break;
+        }
+
+        if (demux_pkt->stream_index == vstrm_idx) video_packets.put(demux_pkt);
+        else if (audio_available && demux_pkt->stream_index == astrm_idx) audio_packets.put(demux_pkt);
+        else av_packet_unref(demux_pkt);
+    }
+
+    // errors end the stream the same way as the end of the file
+    video_packets.put_eof();
+    audio_packets.put_eof();
+}
+
+void video::audio_loop() {
+    AVPacket *audio_pkt = av_packet_alloc();
+    if (!audio_pkt) return;
+
+    bool draining = false;
+    while (threads_running.load() && !draining) {
+        int ret = audio_packets.get(audio_pkt);
+        if (ret < 0) break;
+        if (ret == 0) {
+            // flush the frames the decoder still holds
+            avcodec_send_packet(audio_codec, nullptr);
+            draining = true;
+        } else {
+            ret = avcodec_send_packet(audio_codec, audio_pkt);
+            av_packet_unref(audio_pkt);
+            if (ret < 0) {
+                av_make_error_string(audio_errbuf, sizeof(audio_errbuf), ret);
+                fprintf(stderr, "fail to av_send_packet (audio): %s\n", audio_errbuf);
+                continue;
             }
         }
 
-        if (!end_of_stream_pkt) {
-            if (pkt->stream_index == vstrm_idx) {
-                ret = avcodec_send_packet(codec, pkt);
-                if (ret < 0) {
-                    av_make_error_string(errbuf, sizeof(errbuf), ret);
-                    fprintf(stderr, "fail to av_send_packet: %s\n", errbuf);
-                }
-            } else if (audio_available && pkt->stream_index == astrm_idx) {
-                // decode audio packet
-                ret = avcodec_send_packet(audio_codec, pkt);
-                if (ret < 0) {
-                    av_make_error_string(errbuf, sizeof(errbuf), ret);
-                    fprintf(stderr, "fail to av_send_packet (audio): %s\n", errbuf);
-                }
+        while (true) {
+            ret = avcodec_receive_frame(audio_codec, audio_frame);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            }
+            if (ret < 0) {
+                av_make_error_string(audio_errbuf, sizeof(audio_errbuf), ret);
+                fprintf(stderr, "fail to av_receive_frame (audio): %s\n", audio_errbuf);
+                break;
+            }
+            if (!write_audio_frame()) break;
+        }
+    }
 
-                while (ret >= 0) {
-                    ret = avcodec_receive_frame(audio_codec, audio_frame);
-                    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                        break;
-                    }
-                    if (ret < 0) {
-                        av_make_error_string(errbuf, sizeof(errbuf), ret);
-                        fprintf(stderr, "fail to av_receive_frame (audio): %s\n", errbuf);
-                        break;
-                    }
+    av_packet_free(&audio_pkt);
+}
 
-                    // check if we have valid audio data
-                    if (!audio_frame->nb_samples || !swr_ctx) {
-                        break;
-                    }
+bool video::write_audio_frame() {
+    // check if we have valid audio data
+    if (!audio_frame->nb_samples || !swr_ctx) return true;
 
-                    // resample audio
-                    int out_samples = av_rescale_rnd(
-                        swr_get_delay(swr_ctx, audio_codec->sample_rate) + audio_frame->nb_samples,
-                        audio_codec->sample_rate,
-                        audio_codec->sample_rate,
-                        AV_ROUND_UP);
+    // upper bound of the resampled output, including samples buffered in the resampler
+    int out_samples = swr_get_out_samples(swr_ctx, audio_frame->nb_samples);
+    if (out_samples <= 0) return true;
 
-                    if (out_samples <= 0) break;
+    int frame_bytes = audio_codec->ch_layout.nb_channels * 2;
+    size_t needed = (size_t) out_samples * frame_bytes;
 
-                    int nb_channels = audio_codec->ch_layout.nb_channels;
-                    std::vector<uint8_t> audio_data(out_samples * nb_channels * 2);
-                    uint8_t *out_ptr = audio_data.data();
+    // a frame larger than the whole ring can never fit, so it is the only thing still dropped
+    if (needed > audio_buffer.capacity()) {
+        if (audio_clock.started.load())
+            audio_clock.skipped.store(audio_clock.skipped.load()
+                                      + (double) audio_frame->nb_samples / audio_codec->sample_rate);
+        return true;
+    }
 
-                    int converted = swr_convert(swr_ctx,
-                                                &out_ptr,
-                                                out_samples,
-                                                (const uint8_t **) audio_frame->data,
-                                                audio_frame->nb_samples);
+    // back-pressure, wait for the callback to make room instead of dropping the frame
+    // the packet queue backs up behind this thread and in turn holds the demuxer back
+    if (!audio_buffer.wait_writable(needed)) return false;
 
-                    if (converted > 0) {
-                        audio_data.resize(converted * nb_channels * 2);
+    // the clock starts at the first sample that is buffered, the callback only
+    // reads start_pts after the first commit below has published it
+    if (!audio_clock.started.load()) {
+        int64_t ts = audio_frame->best_effort_timestamp;
+        audio_clock.start_pts = ts != AV_NOPTS_VALUE ? ts * av_q2d(astrm->time_base) - stream_start : 0;
+        audio_clock.started.store(true);
+    }
 
-                        std::lock_guard<std::mutex> lock(audio_buffer.mutex);
-                        if (audio_buffer.queue.size() < audio_buffer.max_size) {
-                            audio_buffer.queue.push(std::move(audio_data));
-                        }
-                    }
-                }
-            }
+    // resample straight into the ring, when the free space wraps around the end
+    // the resampler is drained into the start of the ring with a second call
+    uint8_t *first, *second;
+    size_t first_len, second_len;
+    audio_buffer.write_regions(first, first_len, second, second_len);
+    int first_samples = static_cast<int>(first_len / frame_bytes);
+
+    int converted = swr_convert(swr_ctx,
+                                &first,
+                                first_samples,
+                                (const uint8_t **) audio_frame->data,
+                                audio_frame->nb_samples);
+    if (converted == first_samples && second_len > 0) {
+        int more = swr_convert(swr_ctx, &second, static_cast<int>(second_len / frame_bytes), nullptr, 0);
+        if (more > 0) converted += more;
+    }
+
+    if (converted > 0) audio_buffer.commit((size_t) converted * frame_bytes);
+    return true;
+}
+
+// the destination planes are owned by the caller, the wrapping AVBuffer must not free them
+static void no_free([[maybe_unused]] void *opaque, [[maybe_unused]] uint8_t *data) {
+}
+
+int video::get_frame(const frame_buffer &dst) {
+    int ret;
+    bool got_video_frame = false;
+
+    if (dst.width != dst_width || dst.height != dst_height) return 1;
+
+    // the first frame may already have been decoded while opening
+    if (pending_frame) {
+        pending_frame = false;
+        ret = 0;
+        got_video_frame = true;
+    }
+
+    while (!got_video_frame && !end_of_stream_enc) {
+        if (!end_of_stream_pkt) {
+            if (demux_packet() < 0) return -1;
         }
 
         ret = avcodec_receive_frame(codec, decframe);
@@ -307,19 +529,93 @@ int video::get_frame(int dst_w, int dst_h, const char *dst_frame) {
 
         if (ret == 0) got_video_frame = true;
         else got_video_frame = false;
-
-        av_packet_unref(pkt);
-    } while (!got_video_frame && !end_of_stream_enc);
+    }
 
     if (end_of_stream_enc) return -1;
 
-    sws_scale(swsctx, decframe->data, decframe->linesize, 0, decframe->height, frame->data, frame->linesize);
-    av_image_copy_to_buffer((uint8_t *) dst_frame, get_dst_buf_size(), frame->data, frame->linesize, dst_pix_fmt,
-                            dst_width, dst_height, 1);
+    // frames without a timestamp are placed one nominal frame after the previous one
+    int64_t ts = decframe->best_effort_timestamp;
+    if (ts != AV_NOPTS_VALUE) frame_pts = ts * av_q2d(vstrm->time_base) - stream_start;
+    else frame_pts += 1.0 / get_fps();
+
+    // scale straight into the caller's planes, there is no intermediate copy
+#if SWS_HAS_THREADS
+    // sws_scale_frame only writes into refcounted frames, so wrap the caller's buffer
+    frame->buf[0] = av_buffer_create(dst.data[0], get_dst_buf_size(dst_width, dst_height, dst_pix_fmt),
+                                     no_free, nullptr, 0);
+    if (!frame->buf[0]) return -1;
+    for (int i = 0; i < 4; i++) {
+        frame->data[i] = dst.data[i];
+        frame->linesize[i] = dst.linesize[i];
+    }
+    frame->width = dst_width;
+    frame->height = dst_height;
+    frame->format = dst_pix_fmt;
+    ret = sws_scale_frame(swsctx, frame, decframe);
+    av_frame_unref(frame);
+    if (ret < 0) return -1;
+#else
+    sws_scale(swsctx, decframe->data, decframe->linesize, 0, decframe->height, dst.data, dst.linesize);
+#endif
 
     return 0;
 }
 
+double video::get_frame_pts() const {
+    return frame_pts;
+}
+
+void video::start_audio() {
+    if (audio_available) SDL_PauseAudio(0);
+}
+
+bool video::get_audio_clock(double &clock) const {
+    if (!audio_available) return false;
+    long long callback_time = audio_clock.callback_time.load();
+    if (callback_time == 0) return false;
+
+    // between callbacks the device keeps playing, so advance with the wall clock for up to
+    // one buffer. if no callback got samples for longer than that, the audio has run dry
+    double since = (double) (steady_now_us() - callback_time) / 1000000.0;
+    if (since > 2.0 * audio_clock.chunk) return false;
+    clock = audio_clock.at_callback.load() + std::min(since, audio_clock.chunk);
+    return true;
+}
+
+int video::skip_frames(int n) {
+    if (n <= 0) return 0;
+
+    // let the decoder drop frames that no other frame references, reference
+    // frames still have to be decoded for the frames after the skip to be correct
+    codec->skip_frame = AVDISCARD_NONREF;
+
+    // count video packets rather than decoded frames, since discarded frames
+    // never come out of the decoder. the decoder delay stays the same, so the
+    // next get_frame lands n frames further into the stream
+    int skipped = 0;
+    int ret;
+    if (pending_frame) {
+        pending_frame = false;
+        skipped++;
+    }
+    while (skipped < n && !end_of_stream_enc) {
+        if (!end_of_stream_pkt) {
+            ret = demux_packet();
+            if (ret < 0) break;
+            skipped += ret;
+        }
+
+        // drain whatever the decoder produced, these are never scaled or copied
+        while ((ret = avcodec_receive_frame(codec, decframe)) == 0) {
+            if (end_of_stream_pkt) skipped++;
+        }
+        end_of_stream_enc = (AVERROR_EOF == ret);
+    }
+
+    codec->skip_frame = AVDISCARD_DEFAULT;
+    return skipped;
+}
+
 bool video::isOpened() const {
     return opened;
 }
@@ -332,50 +628,147 @@ void video::setResize(int w, int h) {
     dst_width = w;
     dst_height = h;
 
+    // the loop filter and idct shortcuts can change while decoding, lowres cannot
+    if (decode_quality_auto && vstrm->codecpar->width > 0 && vstrm->codecpar->height > 0) {
+        double shown = std::max((double) dst_width / vstrm->codecpar->width,
+                                (double) dst_height / vstrm->codecpar->height);
+        int level = pick_decode_quality(shown);
+        if (codec->lowres > 0) level = DECODE_QUALITY_MAX;
+        apply_decode_quality(level);
+    }
+
     // free old sws context
     if (swsctx) {
         sws_freeContext(swsctx);
         swsctx = nullptr;
     }
 
+#if SWS_HAS_THREADS
+    // swscale splits the output into horizontal slices, each scaled by its own
+    // context on its own thread, so the result matches the single threaded output
+    swsctx = sws_alloc_context();
+    if (swsctx) {
+        av_opt_set_int(swsctx, "srcw", codec->width, 0);
+        av_opt_set_int(swsctx, "srch", codec->height, 0);
+        av_opt_set_int(swsctx, "src_format", codec->pix_fmt, 0);
+        av_opt_set_int(swsctx, "dstw", dst_width, 0);
+        av_opt_set_int(swsctx, "dsth", dst_height, 0);
+        av_opt_set_int(swsctx, "dst_format", dst_pix_fmt, 0);
+        av_opt_set_int(swsctx, "sws_flags", sws_flags, 0);
+        av_opt_set_int(swsctx, "threads", scale_threads, 0);
+        if (sws_init_context(swsctx, nullptr, nullptr) < 0) {
+            sws_freeContext(swsctx);
+            swsctx = nullptr;
+        }
+    }
+#else
     swsctx = sws_getContext(
         codec->width, codec->height, codec->pix_fmt,
         dst_width, dst_height, dst_pix_fmt,
-        SWS_BICUBIC, nullptr, nullptr, nullptr
+        sws_flags, nullptr, nullptr, nullptr
     );
+#endif
 
     if (!swsctx) {
         fprintf(stderr, "fail to sws_getContext\n");
         return;
     }
+}
 
-    // realloc frame buffer
-    if (alloc && frame->data[0]) {
-        av_freep(&frame->data[0]);
+bool video::decode_first_frame() {
+    while (!end_of_stream_enc) {
+        if (!end_of_stream_pkt && demux_packet() < 0) return false;
+        int ret = avcodec_receive_frame(codec, decframe);
+        if (ret == 0) {
+            pending_frame = true;
+            return codec->width > 0 && codec->height > 0;
+        }
+        end_of_stream_enc = (AVERROR_EOF == ret);
     }
+    return false;
+}
 
-    int ret = av_image_alloc(frame->data, frame->linesize,
-                             dst_width, dst_height, dst_pix_fmt, 16);
-    if (ret < 0) {
-        fprintf(stderr, "fail to av_image_alloc\n");
-        alloc = false;
-        return;
-    }
-    alloc = true;
+void video::apply_decode_quality(int level) {
+    decode_quality = level;
+    codec->skip_loop_filter = level >= 2 ? AVDISCARD_ALL : level >= 1 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    codec->skip_idct = level >= 2 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+}
+
+int video::get_decode_quality() const {
+    return decode_quality;
+}
+
+int video::get_lowres() const {
+    return codec->lowres;
+}
+
+int video::get_decode_threads() const {
+    // thread_count is left as requested when the codec supports neither threading mode
+    return codec->active_thread_type ? codec->thread_count : 1;
+}
+
+int video::get_decode_thread_type() const {
+    return codec->active_thread_type;
+}
+
+int video::get_scale_threads() const {
+    return scale_threads;
+}
+
+const char *video::get_io_backend_name() const {
+    return io ? io->get_backend_name() : "avformat";
+}
+
+long long video::get_io_wait_time() const {
+    return io ? io->get_wait_time() : 0;
+}
+
+AVPixelFormat video::get_dst_pix_fmt() const {
+    return dst_pix_fmt;
+}
+
+AVColorSpace video::get_colorspace() const {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(codec->pix_fmt);
+    // swscale uses bt.601 when it converts rgb sources to yuv
+    if (desc && (desc->flags & AV_PIX_FMT_FLAG_RGB)) return AVCOL_SPC_SMPTE170M;
+    if (codec->colorspace != AVCOL_SPC_UNSPECIFIED && codec->colorspace != AVCOL_SPC_RESERVED)
+        return codec->colorspace;
+    return src_height > 576 ? AVCOL_SPC_BT709 : AVCOL_SPC_SMPTE170M;
+}
+
+void video::set_scale_flags(int flags) {
+    sws_flags = flags;
+}
+
+void video::abort() {
+    threads_running = false;
+    if (io) io->abort();
+    video_packets.abort();
+    audio_packets.abort();
+    audio_buffer.abort();
 }
 
 video::~video() {
-    av_freep(&frame->data);
-    av_freep(&decframe->data);
+    // stop the demux and audio threads before anything they use is freed, the input is
+    // aborted too so a demuxer waiting on a stalled pipe returns
+    abort();
+    if (demux_thread.joinable()) demux_thread.join();
+    if (audio_thread.joinable()) audio_thread.join();
+
+    if (swsctx) sws_freeContext(swsctx);
     av_frame_free(&frame);
     av_frame_free(&decframe);
     av_packet_free(&pkt);
+    av_packet_free(&demux_pkt);
     avcodec_free_context(&codec);
     avformat_close_input(&inctx);
+    // the custom io context is not freed by avformat
+    delete io;
 
     if (audio_available) {
         SDL_CloseAudio();
         SDL_Quit();
+        audio_buffer.release();
         av_frame_free(&audio_frame);
         avcodec_free_context(&audio_codec);
         swr_free(&swr_ctx);
@@ -383,7 +776,47 @@ video::~video() {
 }
 
 int video::get_dst_buf_size() const {
-    return dst_height * dst_width * 3 + 50;
+    return get_dst_buf_size(dst_width, dst_height, dst_pix_fmt);
+}
+
+int video::get_dst_stride(int w) {
+    return FFALIGN(w * 3, FRAME_BUFFER_ALIGN);
+}
+
+int video::get_dst_buf_size(int w, int h, AVPixelFormat fmt) {
+    frame_buffer fb;
+    return wrap_frame_buffer(fb, nullptr, w, h, fmt);
+}
+
+int video::wrap_frame_buffer(frame_buffer &fb, uint8_t *base, int w, int h, AVPixelFormat fmt) {
+    fb = frame_buffer{};
+    if (fmt == AV_PIX_FMT_BGR24) {
+        fb.data[0] = base;
+        fb.linesize[0] = get_dst_stride(w);
+    } else {
+        // every plane row is aligned, so every plane start is aligned as well
+        if (av_image_fill_linesizes(fb.linesize, fmt, w) < 0) return -1;
+        for (int &linesize: fb.linesize) linesize = FFALIGN(linesize, FRAME_BUFFER_ALIGN);
+    }
+    fb.width = w;
+    fb.height = h;
+    if (fmt == AV_PIX_FMT_BGR24) return fb.linesize[0] * h;
+    return av_image_fill_pointers(fb.data, fmt, h, base, fb.linesize);
+}
+
+bool video::alloc_frame_buffer(frame_buffer &fb, int w, int h, AVPixelFormat fmt) {
+    free_frame_buffer(fb);
+    int size = get_dst_buf_size(w, h, fmt);
+    if (size <= 0) return false;
+    auto *base = static_cast<uint8_t *>(av_malloc(size));
+    if (!base) return false;
+    wrap_frame_buffer(fb, base, w, h, fmt);
+    return true;
+}
+
+void video::free_frame_buffer(frame_buffer &fb) {
+    av_freep(&fb.data[0]);
+    fb = frame_buffer{};
 }
 
 bool video::is_end_of_stream() const {
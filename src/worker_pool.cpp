@@ -0,0 +1,83 @@
+#include "worker_pool.h"
+
+worker_pool::worker_pool(int threads) {
+    for (int i = 0; i < threads; i++) this->threads.emplace_back(&worker_pool::worker_loop, this);
+}
+
+worker_pool::~worker_pool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (std::thread &t: threads) t.join();
+}
+
+void worker_pool::run(int jobs, const std::function<void(int)> &job) {
+    if (jobs <= 0) return;
+    // a single job is not worth waking anyone up for
+    if (jobs == 1 || threads.empty()) {
+        for (int i = 0; i < jobs; i++) job(i);
+        return;
+    }
+
+    unsigned long long this_batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = &job;
+        total_jobs = jobs;
+        next_job = 0;
+        unfinished = jobs;
+        this_batch = ++batch;
+    }
+    work_ready.notify_all();
+
+    for (int i = claim_job(this_batch); i >= 0; i = claim_job(this_batch)) {
+        job(i);
+        finish_job();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this] { return unfinished == 0; });
+    current = nullptr;
+}
+
+int worker_pool::concurrency() const {
+    return static_cast<int>(threads.size()) + 1;
+}
+
+void worker_pool::worker_loop() {
+    unsigned long long seen = 0;
+    while (true) {
+        const std::function<void(int)> *job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [&] { return stopping || batch != seen; });
+            if (stopping) return;
+            seen = batch;
+            job = current;
+        }
+
+        // jobs are claimed against the batch the job function belongs to, so a worker
+        // which is late to a batch never runs it for jobs of the batch after it
+        for (int i = claim_job(seen); i >= 0; i = claim_job(seen)) {
+            (*job)(i);
+            finish_job();
+        }
+    }
+}
+
+int worker_pool::claim_job(unsigned long long of_batch) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (batch != of_batch || current == nullptr || next_job >= total_jobs) return -1;
+    return next_job++;
+}
+
+void worker_pool::finish_job() {
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        last = --unfinished == 0;
+    }
+    if (last) work_done.notify_all();
+}
@@ -0,0 +1,226 @@
+// replays ansi_emitter output through a small terminal model and checks every cell lands
+// where it was emitted, for each combination of REP and ECH
+#include "ansi_emitter.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+struct model_cell {
+    int glyph = -1;
+    int bg = -1;
+    int fg = -1;
+};
+
+// a terminal with autowrap, the sequences the emitter writes and nothing else
+struct terminal_model {
+    int width, height;
+    int row = 0, col = 0;
+    bool wrap = false;
+    int bg = -1, fg = -1;
+    int last = -1;
+    std::vector<model_cell> cells;
+
+    terminal_model(int w, int h) : width(w), height(h), cells(w * h) {}
+
+    void print(int g) {
+        if (wrap) {
+            row++;
+            col = 0;
+            wrap = false;
+        }
+        cells[row * width + col] = {g, bg, fg};
+        last = g;
+        if (col == width - 1) wrap = true;
+        else col++;
+    }
+
+    bool feed(const char *p, const char *end) {
+        while (p < end) {
+            if (*p == '\x1B') {
+                p += 2;
+                std::vector<int> args(1, -1);
+                char op;
+                while (true) {
+                    op = *p++;
+                    if (op >= '0' && op <= '9') args.back() = std::max(args.back(), 0) * 10 + op - '0';
+                    else if (op == ';') args.push_back(-1);
+                    else break;
+                }
+                auto arg = [&](size_t i) { return i < args.size() && args[i] >= 0 ? args[i] : 1; };
+                if (op == 'H') {
+                    row = arg(0) - 1;
+                    col = arg(1) - 1;
+                } else if (op == 'B') {
+                    row = std::min(height - 1, row + arg(0));
+                } else if (op == 'C') {
+                    col = std::min(width - 1, col + arg(0));
+                } else if (op == 'D') {
+                    col = std::max(0, col - arg(0));
+                } else if (op == 'b') {
+                    for (int i = arg(0); i > 0; i--) print(last);
+                } else if (op == 'X') {
+                    for (int i = 0; i < arg(0) && col + i < width; i++) cells[row * width + col + i] = {ANSI_BLANK, bg, bg};
+                } else if (op == 'm') {
+                    for (size_t i = 0; i + 4 < args.size(); i += 5)
+                        (args[i] == 48 ? bg : fg) = args[i + 2] << 16 | args[i + 3] << 8 | args[i + 4];
+                } else {
+                    return false;
+                }
+                if (op != 'b' && op != 'X' && op != 'm') wrap = false;
+            } else if (*p == '\r' || *p == '\n') {
+                if (*p == '\r') col = 0;
+                else row++;
+                wrap = false;
+                p++;
+            } else {
+                int g = 0;
+                while (g < ANSI_GLYPHS && memcmp(p, ansi_glyphs[g].bytes, ansi_glyphs[g].len) != 0) g++;
+                if (g == ANSI_GLYPHS) return false;
+                p += ansi_glyphs[g].len;
+                print(g);
+            }
+        }
+        return true;
+    }
+};
+
+static int pack(const int c[3]) {
+    return c[2] << 16 | c[1] << 8 | c[0];
+}
+
+// both sides show the same pixels: a blank, or any glyph with equal colours, is just the background
+static bool same_look(const model_cell &a, const model_cell &b) {
+    if (a.bg != b.bg) return false;
+    bool a_blank = a.glyph == ANSI_BLANK || a.fg == a.bg;
+    bool b_blank = b.glyph == ANSI_BLANK || b.fg == b.bg;
+    if (a_blank || b_blank) return a_blank && b_blank;
+    return a.glyph == b.glyph && a.fg == b.fg;
+}
+
+static int run_case(std::mt19937 &rng, bool rep, bool ech, std::vector<char> &buf) {
+    int width = 5 + static_cast<int>(rng() % 120);
+    int height = 5 + static_cast<int>(rng() % 40);
+    int video_width = width - static_cast<int>(rng() % 3);
+    const int palette[3][3] = {{0, 0, 0}, {200, 0, 0}, {30, 20, 10}};
+
+    ansi_emitter emit(buf.data(), width);
+    emit.use_runs(rep, ech);
+    std::vector<model_cell> expected(width * height);
+    // cells which are left as the terminal already shows them
+    std::vector<bool> unchanged(width * height);
+    for (int r = 0; r < height - 1; r++)
+        for (int c = 0; c < video_width; c++) {
+            const int *bg = palette[rng() % 3];
+            const int *fg = rng() % 3 ? bg : palette[rng() % 3];
+            int g = rng() % 3 ? ANSI_BLANK : static_cast<int>(rng() % DIFF_CASES);
+            if (rng() % 6 == 0) {
+                expected[r * width + c] = {g, pack(bg), pack(fg)};
+                unchanged[r * width + c] = true;
+                continue;
+            }
+            // the cells skipped right before this one which only show the current background
+            int blank_gap = 0;
+            if (emit.cursor_row() == r && emit.background_color()[0] != ANSI_SGR_UNKNOWN) {
+                for (int gx = c - 1; gx >= emit.cursor_col() && unchanged[r * width + gx]; gx--) {
+                    const model_cell &cell = expected[r * width + gx];
+                    if (cell.bg != pack(emit.background_color()) || (cell.glyph != ANSI_BLANK && cell.fg != cell.bg)) break;
+                    blank_gap++;
+                }
+            }
+            // the main loops move, then set whichever colours changed, then print
+            emit.move_to(r, c, blank_gap);
+            bool bg_same = pack(emit.background_color()) == pack(bg) && emit.background_color()[0] != ANSI_SGR_UNKNOWN;
+            bool fg_same = pack(emit.foreground_color()) == pack(fg) && emit.foreground_color()[0] != ANSI_SGR_UNKNOWN;
+            if (!bg_same && !fg_same) emit.colors(bg, fg);
+            else if (!bg_same) emit.background(bg);
+            else if (!fg_same) emit.foreground(fg);
+            emit.glyph(g);
+            expected[r * width + c] = {g, pack(bg), pack(fg)};
+        }
+    emit.flush();
+
+    terminal_model term(width, height);
+    for (int i = 0; i < width * height; i++) {
+        if (unchanged[i]) term.cells[i] = expected[i];
+    }
+    if (!term.feed(buf.data(), buf.data() + emit.size())) return -1;
+    int wrong = 0;
+    for (int i = 0; i < width * height; i++) {
+        if (expected[i].glyph < 0) {
+            if (term.cells[i].glyph >= 0 && term.cells[i].glyph != ANSI_BLANK) wrong++;
+        } else if (!same_look(expected[i], term.cells[i])) {
+            wrong++;
+        }
+    }
+    return wrong;
+}
+
+int main() {
+    std::vector<char> buf(1 << 20);
+    int failures = 0;
+
+    // a cell changing colour right after a run of blanks that ends up erased with ECH
+    {
+        ansi_emitter emit(buf.data(), 80);
+        emit.use_runs(false, true);
+        const int black[3] = {0, 0, 0}, red[3] = {0, 0, 200};
+        emit.move_to(0, 0);
+        emit.colors(black, black);
+        for (int c = 0; c < 12; c++) {
+            emit.move_to(0, c);
+            emit.glyph(ANSI_BLANK);
+        }
+        emit.move_to(0, 12);
+        emit.background(red);
+        emit.glyph(0);
+        emit.flush();
+        terminal_model term(80, 4);
+        if (!term.feed(buf.data(), buf.data() + emit.size()) || term.cells[12].glyph != 0) {
+            printf("glyph after an erased run is not at column 12\n");
+            failures++;
+        }
+    }
+
+    // the longest cell there is, on a terminal wide and tall enough for 5 digit coordinates
+    {
+        int widest = 0;
+        for (int g = 0; g < ANSI_GLYPHS; g++) {
+            if (ansi_glyphs[g].len > ansi_glyphs[widest].len) widest = g;
+        }
+        const int white[3] = {255, 255, 255}, grey[3] = {128, 128, 128};
+        std::fill(buf.begin(), buf.end(), '\x7f');
+        ansi_emitter emit(buf.data(), 20000);
+        emit.move_to(19998, 19998);
+        emit.colors(white, grey);
+        emit.glyph(widest);
+        emit.flush();
+        int end = static_cast<int>(buf.size());
+        while (end > 0 && buf[end - 1] == '\x7f') end--;
+        if (std::max(end, emit.size()) > ANSI_MAX_CELL_BYTES) {
+            printf("a cell took %d bytes, more than ANSI_MAX_CELL_BYTES\n", std::max(end, emit.size()));
+            failures++;
+        }
+    }
+
+    std::mt19937 rng(1);
+    for (int config = 0; config < 4; config++) {
+        bool rep = config & 1, ech = config & 2;
+        int wrong = 0;
+        for (int i = 0; i < 300; i++) {
+            int w = run_case(rng, rep, ech, buf);
+            if (w < 0) {
+                printf("rep %d ech %d: unknown sequence in output\n", rep, ech);
+                return 1;
+            }
+            wrong += w;
+        }
+        if (wrong > 0) {
+            printf("rep %d ech %d: %d wrong cells\n", rep, ech, wrong);
+            failures++;
+        }
+    }
+
+    if (failures == 0) printf("ok\n");
+    return failures == 0 ? 0 : 1;
+}